@@ -7,650 +7,4831 @@
 #include <cstdlib>
 #include <thread>
 #include <chrono>
+#include <csignal>
+#include <ctime>
+#include <cstdint>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <set>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <optional>
+#include <queue>
+#include <future>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <libpq-fe.h>
+#include <fstream>
+#include <filesystem>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <stdexcept>
+
+static std::string get_env_or_default(const char* key, const std::string& def) {
+    const char* val = std::getenv(key);
+    return val ? std::string(val) : def;
+}
+
+static pqxx::connection* connect_with_retry(const std::string& conn_str) {
+    const int max_attempts = 20;
+    for (int attempt = 1; attempt <= max_attempts; ++attempt) {
+        pqxx::connection* conn = nullptr;
+        try {
+            conn = new pqxx::connection(conn_str);
+            if (conn->is_open()) {
+                std::cout << "Подключение к БД установлено" << std::endl;
+                return conn;
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка подключения (попытка " << attempt
+                      << "): " << e.what() << std::endl;
+        }
+
+        delete conn;
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    std::cerr << "Не удалось подключиться к БД после " << max_attempts << " попыток" << std::endl;
+    exit(1);
+}
+
+class JsonValue {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> fields;
+
+    static JsonValue make_bool(bool value) {
+        JsonValue v;
+        v.type = Type::Bool;
+        v.boolean = value;
+        return v;
+    }
+
+    static JsonValue make_number(double value) {
+        JsonValue v;
+        v.type = Type::Number;
+        v.number = value;
+        return v;
+    }
+
+    static JsonValue make_string(const std::string& value) {
+        JsonValue v;
+        v.type = Type::String;
+        v.text = value;
+        return v;
+    }
+
+    static JsonValue make_array() {
+        JsonValue v;
+        v.type = Type::Array;
+        return v;
+    }
+
+    static JsonValue make_object() {
+        JsonValue v;
+        v.type = Type::Object;
+        return v;
+    }
+
+    const JsonValue* find(const std::string& key) const {
+        for (const auto& field : fields) {
+            if (field.first == key) return &field.second;
+        }
+        return nullptr;
+    }
+
+    std::string get_string(const std::string& key, const std::string& def = "") const {
+        const JsonValue* v = find(key);
+        return v && v->type == Type::String ? v->text : def;
+    }
+
+    double get_number(const std::string& key, double def = 0) const {
+        const JsonValue* v = find(key);
+        return v && v->type == Type::Number ? v->number : def;
+    }
+
+    JsonValue& set(const std::string& key, const JsonValue& value) {
+        fields.emplace_back(key, value);
+        return fields.back().second;
+    }
+
+    void push(const JsonValue& value) {
+        items.push_back(value);
+    }
+
+    static JsonValue parse(const std::string& input) {
+        size_t pos = 0;
+        JsonValue value = parse_value(input, pos, 0);
+        skip_spaces(input, pos);
+        if (pos != input.size()) {
+            throw std::runtime_error("JSON: лишние символы на позиции " + std::to_string(pos));
+        }
+        return value;
+    }
+
+    std::string dump() const {
+        std::string out;
+        dump_to(out);
+        return out;
+    }
+
+private:
+    static constexpr int max_depth = 64;
+
+    static void skip_spaces(const std::string& s, size_t& pos) {
+        while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\n' || s[pos] == '\r')) {
+            ++pos;
+        }
+    }
+
+    static void expect(const std::string& s, size_t& pos, const char* word) {
+        size_t len = std::strlen(word);
+        if (s.compare(pos, len, word) != 0) {
+            throw std::runtime_error("JSON: ожидалось '" + std::string(word) + "' на позиции " + std::to_string(pos));
+        }
+        pos += len;
+    }
+
+    static void append_utf8(std::string& out, unsigned code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    static unsigned parse_hex4(const std::string& s, size_t& pos) {
+        if (pos + 4 > s.size()) {
+            throw std::runtime_error("JSON: неполная escape-последовательность");
+        }
+        unsigned code = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            char c = s[pos + i];
+            unsigned digit;
+            if (c >= '0' && c <= '9') {
+                digit = static_cast<unsigned>(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                digit = static_cast<unsigned>(c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                digit = static_cast<unsigned>(c - 'A' + 10);
+            } else {
+                throw std::runtime_error("JSON: некорректная escape-последовательность на позиции " +
+                                         std::to_string(pos));
+            }
+            code = code * 16 + digit;
+        }
+        pos += 4;
+        return code;
+    }
+
+    static std::string parse_string(const std::string& s, size_t& pos) {
+        std::string out;
+        ++pos;
+        while (pos < s.size() && s[pos] != '"') {
+            char c = s[pos++];
+            if (static_cast<unsigned char>(c) < 0x20) {
+                throw std::runtime_error("JSON: управляющий символ в строке на позиции " + std::to_string(pos - 1));
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= s.size()) break;
+            char e = s[pos++];
+            switch (e) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case '"':
+                case '\\':
+                case '/': out += e; break;
+                case 'u': {
+                    unsigned code = parse_hex4(s, pos);
+                    if (code >= 0xD800 && code < 0xDC00) {
+                        unsigned low = 0;
+                        if (s.compare(pos, 2, "\\u") == 0) {
+                            pos += 2;
+                            low = parse_hex4(s, pos);
+                        }
+                        if (low < 0xDC00 || low > 0xDFFF) {
+                            throw std::runtime_error("JSON: непарный суррогат на позиции " + std::to_string(pos));
+                        }
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                        throw std::runtime_error("JSON: непарный суррогат на позиции " + std::to_string(pos));
+                    }
+                    append_utf8(out, code);
+                    break;
+                }
+                default:
+                    throw std::runtime_error("JSON: некорректная escape-последовательность на позиции " +
+                                             std::to_string(pos - 1));
+            }
+        }
+        if (pos >= s.size()) {
+            throw std::runtime_error("JSON: незакрытая строка");
+        }
+        ++pos;
+        return out;
+    }
+
+    static size_t number_length(const std::string& s, size_t start) {
+        auto digit = [&s](size_t i) { return i < s.size() && s[i] >= '0' && s[i] <= '9'; };
+        size_t i = start;
+        if (i < s.size() && s[i] == '-') ++i;
+        if (i < s.size() && s[i] == '0') {
+            ++i;
+        } else if (digit(i)) {
+            while (digit(i)) ++i;
+        } else {
+            return 0;
+        }
+        if (i < s.size() && s[i] == '.') {
+            if (!digit(++i)) return 0;
+            while (digit(i)) ++i;
+        }
+        if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+            ++i;
+            if (i < s.size() && (s[i] == '+' || s[i] == '-')) ++i;
+            if (!digit(i)) return 0;
+            while (digit(i)) ++i;
+        }
+        if (digit(i)) return 0;
+        return i - start;
+    }
+
+    static JsonValue parse_value(const std::string& s, size_t& pos, int depth) {
+        skip_spaces(s, pos);
+        if (pos >= s.size()) {
+            throw std::runtime_error("JSON: неожиданный конец");
+        }
+        if (depth >= max_depth) {
+            throw std::runtime_error("JSON: вложенность больше " + std::to_string(max_depth));
+        }
+
+        char c = s[pos];
+        if (c == '{') {
+            JsonValue obj = make_object();
+            ++pos;
+            skip_spaces(s, pos);
+            if (pos < s.size() && s[pos] == '}') {
+                ++pos;
+                return obj;
+            }
+            while (true) {
+                skip_spaces(s, pos);
+                if (pos >= s.size() || s[pos] != '"') {
+                    throw std::runtime_error("JSON: ожидался ключ на позиции " + std::to_string(pos));
+                }
+                std::string key = parse_string(s, pos);
+                skip_spaces(s, pos);
+                expect(s, pos, ":");
+                obj.fields.emplace_back(key, parse_value(s, pos, depth + 1));
+                skip_spaces(s, pos);
+                if (pos < s.size() && s[pos] == ',') {
+                    ++pos;
+                    continue;
+                }
+                expect(s, pos, "}");
+                return obj;
+            }
+        }
+        if (c == '[') {
+            JsonValue arr = make_array();
+            ++pos;
+            skip_spaces(s, pos);
+            if (pos < s.size() && s[pos] == ']') {
+                ++pos;
+                return arr;
+            }
+            while (true) {
+                arr.items.push_back(parse_value(s, pos, depth + 1));
+                skip_spaces(s, pos);
+                if (pos < s.size() && s[pos] == ',') {
+                    ++pos;
+                    continue;
+                }
+                expect(s, pos, "]");
+                return arr;
+            }
+        }
+        if (c == '"') {
+            return make_string(parse_string(s, pos));
+        }
+        if (c == 't') {
+            expect(s, pos, "true");
+            return make_bool(true);
+        }
+        if (c == 'f') {
+            expect(s, pos, "false");
+            return make_bool(false);
+        }
+        if (c == 'n') {
+            expect(s, pos, "null");
+            return JsonValue();
+        }
+
+        size_t length = number_length(s, pos);
+        if (length == 0) {
+            throw std::runtime_error("JSON: неожиданный символ на позиции " + std::to_string(pos));
+        }
+        double value = std::strtod(s.substr(pos, length).c_str(), nullptr);
+        if (!std::isfinite(value)) {
+            throw std::runtime_error("JSON: число вне диапазона на позиции " + std::to_string(pos));
+        }
+        pos += length;
+        return make_number(value);
+    }
+
+    static void dump_string(std::string& out, const std::string& value) {
+        out += '"';
+        for (char c : value) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char buf[8];
+                        std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+                        out += buf;
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+        out += '"';
+    }
+
+    void dump_to(std::string& out) const {
+        switch (type) {
+            case Type::Null:
+                out += "null";
+                break;
+            case Type::Bool:
+                out += boolean ? "true" : "false";
+                break;
+            case Type::Number: {
+                char buf[32];
+                if (!std::isfinite(number)) {
+                    std::snprintf(buf, sizeof(buf), "null");
+                } else if (std::fabs(number) < 9007199254740992.0 && number == std::floor(number)) {
+                    std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(number));
+                } else {
+                    std::snprintf(buf, sizeof(buf), "%.17g", number);
+                }
+                out += buf;
+                break;
+            }
+            case Type::String:
+                dump_string(out, text);
+                break;
+            case Type::Array:
+                out += '[';
+                for (size_t i = 0; i < items.size(); ++i) {
+                    if (i > 0) out += ',';
+                    items[i].dump_to(out);
+                }
+                out += ']';
+                break;
+            case Type::Object:
+                out += '{';
+                for (size_t i = 0; i < fields.size(); ++i) {
+                    if (i > 0) out += ',';
+                    dump_string(out, fields[i].first);
+                    out += ':';
+                    fields[i].second.dump_to(out);
+                }
+                out += '}';
+                break;
+        }
+    }
+};
+
+struct LibrarySql {
+    static std::string books_by_genre(const std::string& genre) {
+        return "SELECT b.title, g.genre, b.published_year, b.language, "
+               "CASE WHEN b.is_reference THEN 'Да' ELSE 'Нет' END as is_reference "
+               "FROM books b "
+               "JOIN genres g ON b.genre_id = g.genre_id "
+               "WHERE g.genre = '" + genre + "' "
+               "ORDER BY b.title";
+    }
+
+    static std::string books_with_multiple_authors() {
+        return "SELECT b.title, COUNT(ba.author_id) as author_count "
+               "FROM books b "
+               "JOIN book_authors ba ON b.book_id = ba.book_id "
+               "GROUP BY b.book_id, b.title "
+               "HAVING COUNT(ba.author_id) > 1 "
+               "ORDER BY author_count DESC, b.title";
+    }
+
+    static std::string authors_book_count() {
+        return "SELECT a.full_name, COUNT(ba.book_id) as book_count "
+               "FROM authors a "
+               "LEFT JOIN book_authors ba ON a.author_id = ba.author_id "
+               "GROUP BY a.author_id, a.full_name "
+               "ORDER BY book_count DESC, a.full_name";
+    }
+
+    static std::string available_copies_by_title(const std::string& title) {
+        return "SELECT b.title, c.inventory_number, c.location "
+               "FROM copies c "
+               "JOIN books b ON c.book_id = b.book_id "
+               "WHERE b.title = '" + title + "' AND c.status = 'in_stock' "
+               "ORDER BY c.inventory_number COLLATE \"C\"";
+    }
+
+    static std::string active_loans() {
+        return "SELECT r.full_name as reader, b.title as book, "
+               "c.inventory_number, l.loan_date, l.due_date "
+               "FROM loans l "
+               "JOIN readers r ON l.reader_id = r.reader_id "
+               "JOIN copies c ON l.copy_id = c.copy_id "
+               "JOIN books b ON c.book_id = b.book_id "
+               "WHERE l.return_date IS NULL "
+               "ORDER BY l.due_date, r.full_name COLLATE \"C\"";
+    }
+
+    static std::string overdue_loans() {
+        return "SELECT r.full_name as reader, b.title as book, "
+               "l.due_date, (CURRENT_DATE - l.due_date) as days_overdue, "
+               "l.fine_amount "
+               "FROM loans l "
+               "JOIN readers r ON l.reader_id = r.reader_id "
+               "JOIN copies c ON l.copy_id = c.copy_id "
+               "JOIN books b ON c.book_id = b.book_id "
+               "WHERE l.return_date IS NULL AND l.due_date < CURRENT_DATE "
+               "ORDER BY days_overdue DESC";
+    }
+
+    static std::string popular_genres() {
+        return "SELECT g.genre, COUNT(l.loan_id) as loan_count "
+               "FROM loans l "
+               "JOIN copies c ON l.copy_id = c.copy_id "
+               "JOIN books b ON c.book_id = b.book_id "
+               "JOIN genres g ON b.genre_id = g.genre_id "
+               "GROUP BY g.genre "
+               "ORDER BY loan_count DESC, g.genre COLLATE \"C\"";
+    }
+
+    static std::string close_loan() {
+        return "UPDATE loans "
+               "SET return_date = CURRENT_DATE, "
+               "fine_amount = GREATEST(0, CURRENT_DATE - due_date) * 10 "
+               "WHERE loan_id = $1 AND return_date IS NULL "
+               "RETURNING loan_id, copy_id";
+    }
+
+    static std::string loan_info() {
+        return "SELECT l.loan_id, r.full_name as reader, b.title as book, "
+               "l.due_date, l.return_date, l.fine_amount "
+               "FROM loans l "
+               "JOIN readers r ON l.reader_id = r.reader_id "
+               "JOIN copies c ON l.copy_id = c.copy_id "
+               "JOIN books b ON c.book_id = b.book_id "
+               "WHERE l.loan_id = $1";
+    }
+
+    static std::string search_books() {
+        return "SELECT title, published_year, language FROM books WHERE title ILIKE $1";
+    }
+
+    static std::string notify_loan_event() {
+        return "SELECT pg_notify('loan_events', json_build_object("
+               "'op', $2::text, 'loan_id', loan_id, 'reader_id', reader_id, "
+               "'loan_date', loan_date, 'due_date', due_date, 'return_date', return_date, "
+               "'fine_amount', fine_amount, 'xid', pg_current_xact_id()::text)::text) "
+               "FROM loans WHERE loan_id = $1";
+    }
+
+    static std::string open_loans_by_reader() {
+        return "SELECT reader_id, loan_id, due_date::text AS due_date "
+               "FROM loans WHERE return_date IS NULL";
+    }
+
+    static std::string reader_loan_totals() {
+        return "SELECT reader_id, SUM(fine_amount) AS fine_amount, "
+               "GREATEST(MAX(loan_date), MAX(return_date))::text AS last_activity "
+               "FROM loans GROUP BY reader_id";
+    }
+
+    static std::string reader_summaries() {
+        return "SELECT a.reader_id, a.open_loans, a.overdue, a.fine_amount, a.last_activity, "
+               "CURRENT_DATE::text AS today, s.snapshot "
+               "FROM (SELECT pg_current_snapshot()::text AS snapshot) s "
+               "LEFT JOIN ("
+               "SELECT reader_id, "
+               "COUNT(*) FILTER (WHERE return_date IS NULL) AS open_loans, "
+               "COUNT(*) FILTER (WHERE return_date IS NULL AND due_date < CURRENT_DATE) AS overdue, "
+               "SUM(fine_amount) AS fine_amount, "
+               "GREATEST(MAX(loan_date), MAX(return_date))::text AS last_activity "
+               "FROM loans GROUP BY reader_id) a ON true";
+    }
+
+    static std::string insert_reader(pqxx::transaction_base& txn, const std::string& full_name,
+                                     const std::string& group, const std::string& email,
+                                     const std::string& status) {
+        return "INSERT INTO readers (full_name, \"group\", email, status) VALUES (" +
+               txn.quote(full_name) + ", " +
+               (group.empty() ? "NULL" : txn.quote(group)) + ", " +
+               (email.empty() ? "NULL" : txn.quote(email)) + ", " +
+               txn.quote(status) + ") "
+               "RETURNING reader_id, full_name, status";
+    }
+
+    static std::string lock_copy() {
+        return "SELECT c.copy_id, c.book_id, c.status, b.title "
+               "FROM copies c "
+               "JOIN books b ON c.book_id = b.book_id "
+               "WHERE c.copy_id = $1 FOR UPDATE";
+    }
+
+    static std::string insert_loan() {
+        return "INSERT INTO loans (reader_id, copy_id, due_date) "
+               "VALUES ($1, $2, $3) "
+               "RETURNING loan_id";
+    }
+
+    static std::string release_copy() {
+        return "UPDATE copies SET status = 'in_stock' WHERE copy_id = $1";
+    }
+
+    static std::string mark_copy_loaned() {
+        return "UPDATE copies SET status = 'loaned' WHERE copy_id = $1";
+    }
+
+    static std::string reserve_copy() {
+        return "UPDATE copies SET status = 'reserved' WHERE copy_id = $1";
+    }
+
+    static std::string assign_next_hold() {
+        return "UPDATE holds "
+               "SET status = 'ready', copy_id = $1, expires_at = NOW() + make_interval(days => $2) "
+               "WHERE hold_id = ("
+               "SELECT h.hold_id FROM holds h "
+               "WHERE h.book_id = (SELECT book_id FROM copies WHERE copy_id = $1) "
+               "AND h.status = 'waiting' AND h.expires_at > NOW() "
+               "ORDER BY h.created_at, h.hold_id "
+               "LIMIT 1 FOR UPDATE SKIP LOCKED) "
+               "RETURNING hold_id, book_id, reader_id, expires_at";
+    }
+
+    static std::string place_hold() {
+        return "INSERT INTO holds (book_id, reader_id, expires_at) "
+               "VALUES ($1, $2, NOW() + make_interval(days => $3)) "
+               "ON CONFLICT (book_id, reader_id) WHERE status IN ('waiting', 'ready') DO NOTHING "
+               "RETURNING hold_id, (EXTRACT(EPOCH FROM created_at) * 1000000)::BIGINT AS created_us";
+    }
+
+    static std::string ready_hold_for_copy() {
+        return "SELECT hold_id, reader_id FROM holds "
+               "WHERE copy_id = $1 AND status = 'ready' FOR UPDATE";
+    }
+
+    static std::string fulfill_hold() {
+        return "UPDATE holds SET status = 'fulfilled' WHERE hold_id = $1";
+    }
+
+    static std::string next_waiting_hold() {
+        return "SELECT hold_id, reader_id FROM holds "
+               "WHERE book_id = $1 AND status = 'waiting' AND expires_at > NOW() "
+               "ORDER BY created_at, hold_id "
+               "LIMIT 1 FOR UPDATE SKIP LOCKED";
+    }
+
+    static std::string in_stock_copy() {
+        return "SELECT copy_id, inventory_number FROM copies "
+               "WHERE book_id = $1 AND status = 'in_stock' "
+               "ORDER BY copy_id LIMIT 1";
+    }
+
+    static std::string waiting_holds() {
+        return "SELECT hold_id, reader_id, (EXTRACT(EPOCH FROM created_at) * 1000000)::BIGINT AS created_us "
+               "FROM holds "
+               "WHERE book_id = $1 AND status = 'waiting' AND expires_at > NOW() "
+               "ORDER BY created_at, hold_id";
+    }
+
+    static std::string expire_waiting_holds() {
+        return "UPDATE holds SET status = 'expired' "
+               "WHERE status = 'waiting' AND expires_at <= NOW() "
+               "RETURNING book_id";
+    }
+
+    static std::string expire_ready_holds() {
+        return "WITH due AS ("
+               "SELECT h.hold_id FROM holds h JOIN copies c ON c.copy_id = h.copy_id "
+               "WHERE h.status = 'ready' AND h.expires_at <= NOW() "
+               "FOR UPDATE OF c SKIP LOCKED) "
+               "UPDATE holds SET status = 'expired' "
+               "WHERE hold_id IN (SELECT hold_id FROM due) AND status = 'ready' "
+               "RETURNING book_id, copy_id";
+    }
+
+    static std::vector<std::string> schema() {
+        return {
+            "CREATE TABLE IF NOT EXISTS genres ("
+            "genre_id SERIAL PRIMARY KEY,"
+            "genre VARCHAR(100) NOT NULL UNIQUE)",
+
+            "CREATE TABLE IF NOT EXISTS authors ("
+            "author_id SERIAL PRIMARY KEY,"
+            "full_name VARCHAR(200) NOT NULL,"
+            "country VARCHAR(100))",
+
+            "CREATE TABLE IF NOT EXISTS readers ("
+            "reader_id SERIAL PRIMARY KEY,"
+            "full_name VARCHAR(200) NOT NULL,"
+            "\"group\" VARCHAR(50),"
+            "email VARCHAR(150) UNIQUE,"
+            "status VARCHAR(50) NOT NULL DEFAULT 'active',"
+            "registration_date DATE NOT NULL DEFAULT CURRENT_DATE)",
+
+            "CREATE TABLE IF NOT EXISTS books ("
+            "book_id SERIAL PRIMARY KEY,"
+            "genre_id INT REFERENCES genres(genre_id),"
+            "title VARCHAR(255) NOT NULL,"
+            "isbn VARCHAR(32) UNIQUE,"
+            "published_year INT,"
+            "language VARCHAR(50),"
+            "is_reference BOOLEAN NOT NULL DEFAULT FALSE)",
+
+            "CREATE TABLE IF NOT EXISTS book_authors ("
+            "book_id INT NOT NULL REFERENCES books(book_id) ON DELETE CASCADE,"
+            "author_id INT NOT NULL REFERENCES authors(author_id) ON DELETE CASCADE,"
+            "PRIMARY KEY (book_id, author_id))",
+
+            "CREATE TABLE IF NOT EXISTS copies ("
+            "copy_id SERIAL PRIMARY KEY,"
+            "book_id INT NOT NULL REFERENCES books(book_id) ON DELETE CASCADE,"
+            "inventory_number VARCHAR(50) UNIQUE,"
+            "location VARCHAR(100),"
+            "status VARCHAR(50) NOT NULL DEFAULT 'in_stock')",
+
+            "CREATE TABLE IF NOT EXISTS loans ("
+            "loan_id SERIAL PRIMARY KEY,"
+            "reader_id INT NOT NULL REFERENCES readers(reader_id),"
+            "copy_id INT NOT NULL REFERENCES copies(copy_id),"
+            "loan_date DATE NOT NULL DEFAULT CURRENT_DATE,"
+            "due_date DATE NOT NULL,"
+            "return_date DATE,"
+            "fine_amount NUMERIC(10,2) NOT NULL DEFAULT 0)",
+
+            "CREATE TABLE IF NOT EXISTS reminder_log ("
+            "loan_id INT NOT NULL REFERENCES loans(loan_id) ON DELETE CASCADE,"
+            "kind VARCHAR(20) NOT NULL,"
+            "sent_at TIMESTAMP NOT NULL DEFAULT NOW(),"
+            "PRIMARY KEY (loan_id, kind))",
+
+            "CREATE TABLE IF NOT EXISTS holds ("
+            "hold_id SERIAL PRIMARY KEY,"
+            "book_id INT NOT NULL REFERENCES books(book_id) ON DELETE CASCADE,"
+            "reader_id INT NOT NULL REFERENCES readers(reader_id),"
+            "created_at TIMESTAMP NOT NULL DEFAULT NOW(),"
+            "expires_at TIMESTAMP NOT NULL,"
+            "status VARCHAR(20) NOT NULL DEFAULT 'waiting',"
+            "copy_id INT REFERENCES copies(copy_id))",
+
+            "CREATE UNIQUE INDEX IF NOT EXISTS holds_active_reader "
+            "ON holds (book_id, reader_id) WHERE status IN ('waiting', 'ready')",
+
+            "CREATE INDEX IF NOT EXISTS holds_queue "
+            "ON holds (book_id, created_at, hold_id) WHERE status = 'waiting'",
+
+            "CREATE INDEX IF NOT EXISTS holds_copy "
+            "ON holds (copy_id) WHERE status = 'ready'",
+
+            "CREATE INDEX IF NOT EXISTS copies_in_stock "
+            "ON copies (book_id, copy_id) WHERE status = 'in_stock'"
+        };
+    }
+};
+
+enum class OpClass { Interactive, Report, Write };
+
+struct OpLimits {
+    int statement_ms;
+    int lock_ms;
+    int deadline_ms;
+    int grace_ms;
+};
+
+static OpLimits op_limits_from_env(const char* statement_key, const std::string& statement_def,
+                                   const char* lock_key, const std::string& lock_def) {
+    int statement_ms = std::stoi(get_env_or_default(statement_key, statement_def));
+    int lock_ms = std::stoi(get_env_or_default(lock_key, lock_def));
+    int grace_ms = std::stoi(get_env_or_default("CLIENT_GRACE_MS", "1000"));
+    return OpLimits{statement_ms, lock_ms, statement_ms + grace_ms, std::max(grace_ms, 1000)};
+}
+
+static volatile std::sig_atomic_t interrupt_requested = 0;
+static std::atomic<int> active_operations{0};
+
+static void interrupt_handler(int sig) {
+    if (active_operations.load() == 0) {
+        std::signal(sig, SIG_DFL);
+        std::raise(sig);
+        return;
+    }
+    interrupt_requested = 1;
+}
+
+struct WatchedBackend {
+    int pid;
+    int socket;
+};
+
+class QueryWatchdog {
+private:
+    struct Armed {
+        std::vector<WatchedBackend> backends;
+        std::chrono::steady_clock::time_point deadline;
+        std::chrono::milliseconds grace;
+        std::chrono::steady_clock::time_point abandon_at;
+        bool cancelled;
+        bool abandoned;
+        bool busy;
+    };
+
+    struct Action {
+        long token;
+        std::vector<WatchedBackend> backends;
+        const char* reason;
+        bool abandon;
+    };
+
+    std::string conn_str;
+    pqxx::connection* side_conn;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable settled;
+    std::map<long, Armed> armed;
+    long next_token;
+    bool stopping;
+    std::thread worker;
+
+    void cancel(const std::vector<WatchedBackend>& backends, const std::string& reason) {
+        std::cerr << "\nЗапрос отменен: " << reason << std::endl;
+        for (int attempt = 1; attempt <= 2; ++attempt) {
+            try {
+                if (!side_conn || !side_conn->is_open()) {
+                    delete side_conn;
+                    side_conn = nullptr;
+                    side_conn = new pqxx::connection(conn_str);
+                }
+                pqxx::nontransaction txn(*side_conn);
+                for (const auto& backend : backends) {
+                    txn.exec_params("SELECT pg_cancel_backend($1)", backend.pid);
+                }
+                return;
+            } catch (const pqxx::broken_connection &e) {
+                delete side_conn;
+                side_conn = nullptr;
+                if (attempt == 2) {
+                    std::cerr << "Ошибка отмены запроса: " << e.what() << std::endl;
+                }
+            } catch (const std::exception &e) {
+                std::cerr << "Ошибка отмены запроса: " << e.what() << std::endl;
+                return;
+            }
+        }
+    }
+
+    static void abandon(const std::vector<WatchedBackend>& backends) {
+        std::cerr << "\nСервер не ответил на отмену, соединение закрыто" << std::endl;
+        for (const auto& backend : backends) {
+            if (backend.socket >= 0) {
+                shutdown(backend.socket, SHUT_RDWR);
+            }
+        }
+    }
+
+    void loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            wakeup.wait_for(lock, std::chrono::milliseconds(100));
+
+            bool interrupted = interrupt_requested != 0;
+            interrupt_requested = 0;
+            auto now = std::chrono::steady_clock::now();
+            std::vector<Action> actions;
+            for (auto& entry : armed) {
+                Armed& op = entry.second;
+                if (!op.cancelled && (interrupted || now >= op.deadline)) {
+                    op.cancelled = true;
+                    op.busy = true;
+                    op.abandon_at = now + op.grace;
+                    actions.push_back(Action{entry.first, op.backends,
+                                             interrupted ? "прервано пользователем (Ctrl-C)" : "превышен срок выполнения",
+                                             false});
+                } else if (op.cancelled && !op.abandoned && now >= op.abandon_at) {
+                    op.abandoned = true;
+                    op.busy = true;
+                    actions.push_back(Action{entry.first, op.backends, "", true});
+                }
+            }
+
+            if (actions.empty()) continue;
+            lock.unlock();
+            for (const auto& action : actions) {
+                if (action.abandon) {
+                    abandon(action.backends);
+                } else {
+                    cancel(action.backends, action.reason);
+                }
+            }
+            lock.lock();
+            for (const auto& action : actions) {
+                auto it = armed.find(action.token);
+                if (it != armed.end()) it->second.busy = false;
+            }
+            settled.notify_all();
+        }
+    }
+
+public:
+    explicit QueryWatchdog(const std::string& conn_string)
+        : conn_str(conn_string), side_conn(nullptr), next_token(0), stopping(false) {
+        try {
+            side_conn = new pqxx::connection(conn_str);
+        } catch (const std::exception &e) {
+            std::cerr << "Сторож запросов пока без подключения для отмены: " << e.what() << std::endl;
+        }
+        worker = std::thread(&QueryWatchdog::loop, this);
+    }
+
+    ~QueryWatchdog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        worker.join();
+        delete side_conn;
+    }
+
+    long arm(const std::vector<WatchedBackend>& backends, std::chrono::milliseconds budget,
+             std::chrono::milliseconds grace) {
+        std::lock_guard<std::mutex> lock(mutex);
+        long token = ++next_token;
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        armed[token] = Armed{backends, deadline, grace, deadline + grace, false, false, false};
+        active_operations.fetch_add(1);
+        return token;
+    }
+
+    void disarm(long token) {
+        std::unique_lock<std::mutex> lock(mutex);
+        settled.wait(lock, [this, token]() {
+            auto it = armed.find(token);
+            return it == armed.end() || !it->second.busy;
+        });
+        if (armed.erase(token) > 0) {
+            active_operations.fetch_sub(1);
+        }
+    }
+};
+
+class BoundedOperation {
+private:
+    QueryWatchdog& watchdog;
+    OpLimits limits;
+    long token;
+
+public:
+    BoundedOperation(QueryWatchdog& dog, pqxx::connection& conn, const OpLimits& op_limits)
+        : BoundedOperation(dog, std::vector<WatchedBackend>{{conn.backendpid(), conn.sock()}}, op_limits) {}
+
+    BoundedOperation(QueryWatchdog& dog, const std::vector<WatchedBackend>& backends, const OpLimits& op_limits)
+        : watchdog(dog), limits(op_limits),
+          token(dog.arm(backends, std::chrono::milliseconds(op_limits.deadline_ms),
+                        std::chrono::milliseconds(op_limits.grace_ms))) {}
+
+    ~BoundedOperation() {
+        watchdog.disarm(token);
+    }
+
+    BoundedOperation(const BoundedOperation&) = delete;
+    BoundedOperation& operator=(const BoundedOperation&) = delete;
+
+    void apply(pqxx::transaction_base& txn) const {
+        txn.exec("SET LOCAL statement_timeout = " + std::to_string(limits.statement_ms) +
+                 "; SET LOCAL lock_timeout = " + std::to_string(limits.lock_ms));
+    }
+};
+
+struct HoldEntry {
+    long long created_us;
+    int hold_id;
+    int reader_id;
+
+    bool operator<(const HoldEntry& other) const {
+        return created_us != other.created_us ? created_us < other.created_us : hold_id < other.hold_id;
+    }
+};
+
+class HoldQueues {
+private:
+    static constexpr size_t stripe_count = 16;
+
+    struct BookQueue {
+        std::set<HoldEntry> entries;
+        std::chrono::steady_clock::time_point loaded_at;
+    };
+
+    struct Stripe {
+        std::mutex mutex;
+        std::unordered_map<int, BookQueue> books;
+    };
+
+    std::array<Stripe, stripe_count> stripes;
+    std::chrono::seconds max_age;
+
+    Stripe& stripe_for(int book_id) {
+        return stripes[static_cast<size_t>(book_id) % stripe_count];
+    }
+
+public:
+    explicit HoldQueues(std::chrono::seconds refresh_after) : max_age(refresh_after) {}
+
+    bool is_fresh(int book_id) {
+        Stripe& stripe = stripe_for(book_id);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.books.find(book_id);
+        return it != stripe.books.end() &&
+               std::chrono::steady_clock::now() - it->second.loaded_at < max_age;
+    }
+
+    void replace(int book_id, const std::vector<HoldEntry>& entries) {
+        Stripe& stripe = stripe_for(book_id);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        BookQueue& queue = stripe.books[book_id];
+        queue.entries.clear();
+        queue.entries.insert(entries.begin(), entries.end());
+        queue.loaded_at = std::chrono::steady_clock::now();
+    }
+
+    void push(int book_id, const HoldEntry& entry) {
+        Stripe& stripe = stripe_for(book_id);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.books.find(book_id);
+        if (it != stripe.books.end()) {
+            it->second.entries.insert(entry);
+        }
+    }
+
+    void erase(int book_id, int hold_id) {
+        Stripe& stripe = stripe_for(book_id);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.books.find(book_id);
+        if (it == stripe.books.end()) return;
+        auto& entries = it->second.entries;
+        for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+            if (entry->hold_id == hold_id) {
+                entries.erase(entry);
+                return;
+            }
+        }
+    }
+
+    void invalidate(int book_id) {
+        Stripe& stripe = stripe_for(book_id);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        stripe.books.erase(book_id);
+    }
+
+    std::pair<size_t, size_t> position(int book_id, int reader_id) {
+        Stripe& stripe = stripe_for(book_id);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.books.find(book_id);
+        if (it == stripe.books.end()) return {0, 0};
+
+        size_t index = 0;
+        for (const auto& entry : it->second.entries) {
+            ++index;
+            if (entry.reader_id == reader_id) {
+                return {index, it->second.entries.size()};
+            }
+        }
+        return {0, it->second.entries.size()};
+    }
+};
+
+static std::vector<HoldEntry> load_waiting_holds(pqxx::transaction_base& txn, int book_id) {
+    std::vector<HoldEntry> entries;
+    for (const auto& row : txn.exec_params(LibrarySql::waiting_holds(), book_id)) {
+        entries.push_back(HoldEntry{
+            row["created_us"].as<long long>(), row["hold_id"].as<int>(), row["reader_id"].as<int>()
+        });
+    }
+    return entries;
+}
+
+struct ReturnOutcome {
+    bool found;
+    pqxx::result info;
+    pqxx::result assigned;
+};
+
+struct IssueOutcome {
+    enum class Status { NotFound, Issued, Queued };
+
+    Status status;
+    std::string copy_status;
+    std::string title;
+    int book_id;
+    std::string loan_id;
+    pqxx::result hold;
+    pqxx::result assigned;
+};
+
+struct HoldSweep {
+    pqxx::result waiting;
+    pqxx::result ready;
+    std::vector<pqxx::result> reassigned;
+};
+
+struct LoanOps {
+    static pqxx::result assign_copy(pqxx::work& txn, int copy_id, int pickup_days) {
+        pqxx::result assigned = txn.exec_params(LibrarySql::assign_next_hold(), copy_id, pickup_days);
+        if (assigned.empty()) {
+            txn.exec_params(LibrarySql::release_copy(), copy_id);
+        } else {
+            txn.exec_params(LibrarySql::reserve_copy(), copy_id);
+        }
+        return assigned;
+    }
+
+    static ReturnOutcome return_loan(pqxx::work& txn, int loan_id, int pickup_days) {
+        ReturnOutcome outcome{false, pqxx::result(), pqxx::result()};
+        pqxx::result updated = txn.exec_params(LibrarySql::close_loan(), loan_id);
+        if (updated.empty()) {
+            return outcome;
+        }
+
+        int copy_id = updated[0]["copy_id"].as<int>();
+        outcome.found = true;
+        outcome.assigned = assign_copy(txn, copy_id, pickup_days);
+        txn.exec_params(LibrarySql::notify_loan_event(), loan_id, "return");
+        outcome.info = txn.exec_params(LibrarySql::loan_info(), loan_id);
+        return outcome;
+    }
+
+    static IssueOutcome issue_loan(pqxx::work& txn, int reader_id, int copy_id,
+                                   const std::string& due_date, int wait_days, int pickup_days) {
+        IssueOutcome outcome{IssueOutcome::Status::NotFound, "", "", 0, "", pqxx::result(), pqxx::result()};
+        pqxx::result copy = txn.exec_params(LibrarySql::lock_copy(), copy_id);
+        if (copy.empty()) {
+            return outcome;
+        }
+
+        outcome.copy_status = copy[0]["status"].c_str();
+        outcome.title = copy[0]["title"].c_str();
+        outcome.book_id = copy[0]["book_id"].as<int>();
+
+        bool picked_up = false;
+        if (outcome.copy_status == "reserved") {
+            pqxx::result hold = txn.exec_params(LibrarySql::ready_hold_for_copy(), copy_id);
+            if (!hold.empty() && hold[0]["reader_id"].as<int>() == reader_id) {
+                txn.exec_params(LibrarySql::fulfill_hold(), hold[0]["hold_id"].as<int>());
+                picked_up = true;
+            }
+        } else if (outcome.copy_status == "in_stock") {
+            pqxx::result next = txn.exec_params(LibrarySql::next_waiting_hold(), outcome.book_id);
+            if (!next.empty() && next[0]["reader_id"].as<int>() == reader_id) {
+                txn.exec_params(LibrarySql::fulfill_hold(), next[0]["hold_id"].as<int>());
+            } else if (!next.empty()) {
+                outcome.assigned = assign_copy(txn, copy_id, pickup_days);
+                outcome.copy_status = outcome.assigned.empty() ? "in_stock" : "reserved";
+            }
+        }
+
+        if ((outcome.copy_status != "in_stock" && !picked_up) || !outcome.assigned.empty()) {
+            outcome.status = IssueOutcome::Status::Queued;
+            outcome.hold = txn.exec_params(LibrarySql::place_hold(), outcome.book_id, reader_id, wait_days);
+            return outcome;
+        }
+
+        pqxx::result res = txn.exec_params(
+            LibrarySql::insert_loan(),
+            reader_id,
+            copy_id,
+            due_date
+        );
+
+        txn.exec_params(LibrarySql::mark_copy_loaned(), copy_id);
+        txn.exec_params(LibrarySql::notify_loan_event(), res[0]["loan_id"].as<int>(), "issue");
+        outcome.status = IssueOutcome::Status::Issued;
+        outcome.loan_id = res[0]["loan_id"].c_str();
+        return outcome;
+    }
+
+    static HoldSweep expire_holds(pqxx::work& txn, int pickup_days) {
+        HoldSweep sweep;
+        sweep.waiting = txn.exec(LibrarySql::expire_waiting_holds());
+        sweep.ready = txn.exec(LibrarySql::expire_ready_holds());
+        for (const auto& row : sweep.ready) {
+            sweep.reassigned.push_back(assign_copy(txn, row["copy_id"].as<int>(), pickup_days));
+        }
+        return sweep;
+    }
+};
+
+static constexpr int shard_id_span = 100000000;
+
+struct ShardConfig {
+    std::string branch;
+    std::string conn_str;
+};
+
+static size_t shard_for_id(int id, size_t shard_count) {
+    size_t index = static_cast<size_t>(id / shard_id_span);
+    if (id <= 0 || index >= shard_count) {
+        throw std::runtime_error("Нет филиала для id = " + std::to_string(id));
+    }
+    return index;
+}
+
+static void upsert_rows(pqxx::transaction_base& txn, const std::string& table, const std::string& key,
+                        const pqxx::result& rows) {
+    for (const auto& row : rows) {
+        std::string names;
+        std::string values;
+        std::string updates;
+        for (int j = 0; j < rows.columns(); ++j) {
+            std::string name = "\"" + std::string(rows.column_name(j)) + "\"";
+            if (j > 0) {
+                names += ", ";
+                values += ", ";
+            }
+            names += name;
+            values += row[j].is_null() ? "NULL" : txn.quote(std::string(row[j].c_str()));
+            if (rows.column_name(j) != key) {
+                updates += (updates.empty() ? "" : ", ") + name + " = EXCLUDED." + name;
+            }
+        }
+        txn.exec("INSERT INTO " + table + " (" + names + ") VALUES (" + values + ") "
+                 "ON CONFLICT (\"" + key + "\") DO " + (updates.empty() ? "NOTHING" : "UPDATE SET " + updates));
+    }
+}
+
+static pqxx::result existing_rows(pqxx::transaction_base& txn, const std::string& table, const std::string& key,
+                                  const pqxx::result& rows) {
+    std::string values;
+    for (const auto& row : rows) {
+        values += (values.empty() ? "" : ", ") + txn.quote(std::string(row[key].c_str()));
+    }
+    return txn.exec("SELECT * FROM " + table + " WHERE \"" + key + "\" IN (" + values + ")");
+}
+
+static void undo_rows(pqxx::transaction_base& txn, const std::string& table, const std::string& key,
+                      const pqxx::result& rows, const pqxx::result& previous) {
+    std::set<std::string> kept;
+    for (const auto& row : previous) {
+        kept.insert(row[key].c_str());
+    }
+    for (const auto& row : rows) {
+        std::string value = row[key].c_str();
+        if (kept.count(value) > 0) continue;
+        txn.exec("DELETE FROM " + table + " WHERE \"" + key + "\" = " + txn.quote(value));
+    }
+    upsert_rows(txn, table, key, previous);
+}
+
+struct ResultTable {
+    std::vector<std::string> columns;
+    std::vector<std::vector<std::optional<std::string>>> rows;
+
+    static ResultTable from_result(const pqxx::result& res) {
+        ResultTable table;
+        for (int j = 0; j < res.columns(); ++j) {
+            table.columns.push_back(res.column_name(j));
+        }
+        for (const auto& row : res) {
+            std::vector<std::optional<std::string>> values;
+            for (int j = 0; j < res.columns(); ++j) {
+                auto field = row[j];
+                values.push_back(field.is_null() ? std::nullopt : std::optional<std::string>(field.c_str()));
+            }
+            table.rows.push_back(values);
+        }
+        return table;
+    }
+};
+
+struct SortKey {
+    size_t column;
+    bool numeric;
+    bool descending;
+};
+
+static int compare_rows(const std::vector<std::optional<std::string>>& a,
+                        const std::vector<std::optional<std::string>>& b,
+                        const std::vector<SortKey>& keys) {
+    for (const auto& key : keys) {
+        const auto& x = a[key.column];
+        const auto& y = b[key.column];
+        int cmp = 0;
+        if (!x || !y) {
+            cmp = (x ? -1 : 0) + (y ? 1 : 0);
+        } else if (key.numeric) {
+            double dx = std::stod(*x);
+            double dy = std::stod(*y);
+            cmp = dx < dy ? -1 : (dx > dy ? 1 : 0);
+        } else {
+            cmp = x->compare(*y);
+            cmp = cmp < 0 ? -1 : (cmp > 0 ? 1 : 0);
+        }
+        if (cmp != 0) {
+            return key.descending && x && y ? -cmp : cmp;
+        }
+    }
+    return 0;
+}
+
+static ResultTable merge_sorted(const std::vector<ResultTable>& parts, const std::vector<SortKey>& keys) {
+    ResultTable merged;
+    if (parts.empty()) return merged;
+    merged.columns = parts[0].columns;
+
+    auto after = [&](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) {
+        int cmp = compare_rows(parts[a.first].rows[a.second], parts[b.first].rows[b.second], keys);
+        return cmp != 0 ? cmp > 0 : a.first > b.first;
+    };
+    std::priority_queue<std::pair<size_t, size_t>, std::vector<std::pair<size_t, size_t>>, decltype(after)> heads(after);
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (!parts[i].rows.empty()) heads.push({i, 0});
+    }
+
+    while (!heads.empty()) {
+        auto head = heads.top();
+        heads.pop();
+        merged.rows.push_back(parts[head.first].rows[head.second]);
+        if (head.second + 1 < parts[head.first].rows.size()) {
+            heads.push({head.first, head.second + 1});
+        }
+    }
+    return merged;
+}
+
+static ResultTable combine_counts(const std::vector<ResultTable>& parts, size_t key_column, size_t count_column) {
+    ResultTable combined;
+    if (parts.empty()) return combined;
+    combined.columns = parts[0].columns;
+
+    std::map<std::string, long long> totals;
+    for (const auto& part : parts) {
+        for (const auto& row : part.rows) {
+            totals[row[key_column].value_or("")] += std::stoll(row[count_column].value_or("0"));
+        }
+    }
+
+    for (const auto& total : totals) {
+        std::vector<std::optional<std::string>> row(combined.columns.size());
+        row[key_column] = total.first;
+        row[count_column] = std::to_string(total.second);
+        combined.rows.push_back(row);
+    }
+    std::stable_sort(combined.rows.begin(), combined.rows.end(), [&](const auto& a, const auto& b) {
+        return compare_rows(a, b, {{count_column, true, true}, {key_column, false, false}}) < 0;
+    });
+    return combined;
+}
+
+struct ReportOrder {
+    static std::vector<SortKey> available_copies() {
+        return {{1, false, false}};
+    }
+
+    static std::vector<SortKey> active_loans() {
+        return {{4, false, false}, {0, false, false}};
+    }
+
+    static std::vector<SortKey> overdue_loans() {
+        return {{3, true, true}};
+    }
+};
+
+static void add_branch_column(ResultTable& table, const std::string& branch) {
+    table.columns.push_back("branch");
+    for (auto& row : table.rows) {
+        row.push_back(branch);
+    }
+}
+
+static std::vector<ResultTable> scatter_query(const std::vector<pqxx::connection*>& conns, QueryWatchdog& watchdog,
+                                              const OpLimits& limits, const std::string& sql) {
+    std::vector<std::future<ResultTable>> pending;
+    for (auto* conn : conns) {
+        pending.push_back(std::async(std::launch::async, [conn, &watchdog, &limits, &sql]() {
+            BoundedOperation op(watchdog, *conn, limits);
+            pqxx::work txn(*conn);
+            op.apply(txn);
+            ResultTable table = ResultTable::from_result(txn.exec(sql));
+            txn.commit();
+            return table;
+        }));
+    }
+
+    std::vector<ResultTable> parts;
+    for (auto& part : pending) {
+        parts.push_back(part.get());
+    }
+    return parts;
+}
+
+static void replicate_rows(pqxx::connection& primary, const std::vector<pqxx::connection*>& replicas,
+                           QueryWatchdog& watchdog, const OpLimits& limits,
+                           const std::string& table, const std::string& key, const pqxx::result& rows) {
+    const int max_attempts = 3;
+    size_t written = 0;
+    std::vector<std::optional<pqxx::result>> previous(replicas.size());
+    try {
+        for (; written < replicas.size(); ++written) {
+            for (int attempt = 1;; ++attempt) {
+                try {
+                    BoundedOperation op(watchdog, *replicas[written], limits);
+                    pqxx::work txn(*replicas[written]);
+                    op.apply(txn);
+                    if (!previous[written]) {
+                        previous[written] = existing_rows(txn, table, key, rows);
+                    }
+                    upsert_rows(txn, table, key, rows);
+                    txn.commit();
+                    break;
+                } catch (const std::exception &) {
+                    if (attempt >= max_attempts || !replicas[written]->is_open()) throw;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(200 * attempt));
+                }
+            }
+        }
+    } catch (const std::exception &e) {
+        std::vector<std::pair<pqxx::connection*, pqxx::result>> undo;
+        for (size_t i = 0; i <= written && i < replicas.size(); ++i) {
+            if (previous[i]) undo.emplace_back(replicas[i], *previous[i]);
+        }
+        undo.emplace_back(&primary, pqxx::result());
+        for (const auto& target : undo) {
+            try {
+                BoundedOperation op(watchdog, *target.first, limits);
+                pqxx::work txn(*target.first);
+                op.apply(txn);
+                undo_rows(txn, table, key, rows, target.second);
+                txn.commit();
+            } catch (const std::exception &undo_error) {
+                std::cerr << "Не удалось отменить запись в " << table << ": " << undo_error.what() << std::endl;
+            }
+        }
+        throw std::runtime_error("Запись в " + table + " не скопирована во все филиалы и отменена: " + e.what());
+    }
+}
+
+class AsyncPg {
+private:
+    struct Pending {
+        std::promise<ResultTable> promise;
+        ResultTable table;
+        std::string error;
+        bool got_result;
+    };
+
+    struct Job {
+        std::string sql;
+        std::vector<std::string> params;
+        std::promise<ResultTable> promise;
+    };
+
+    struct Link {
+        PGconn* conn;
+        std::deque<Pending> pending;
+        bool want_write;
+        bool broken;
+    };
+
+    std::string conn_str;
+    std::deque<Link> links;
+    int epoll_fd;
+    int wake_fd;
+    std::mutex mutex;
+    std::deque<Job> jobs;
+    bool stopping;
+    std::string loop_error;
+    std::atomic<size_t> broken_links;
+    std::thread loop_thread;
+
+    static void fail(Pending& pending, const std::string& message) {
+        pending.promise.set_exception(std::make_exception_ptr(std::runtime_error(message)));
+    }
+
+    void watch(size_t index, bool want_write) {
+        Link& link = links[index];
+        epoll_event ev = {};
+        ev.events = EPOLLIN | (want_write ? EPOLLOUT : 0u);
+        ev.data.u64 = index;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, PQsocket(link.conn), &ev) < 0) {
+            failLink(index, std::string("Ошибка epoll_ctl: ") + std::strerror(errno));
+            return;
+        }
+        link.want_write = want_write;
+    }
+
+    void flush(size_t index) {
+        int state = PQflush(links[index].conn);
+        if (state < 0) {
+            failLink(index, std::string("Ошибка отправки: ") + PQerrorMessage(links[index].conn));
+            return;
+        }
+        if ((state == 1) != links[index].want_write) {
+            watch(index, state == 1);
+        }
+    }
+
+    void failLink(size_t index, const std::string& message) {
+        for (auto& pending : links[index].pending) {
+            fail(pending, message);
+        }
+        links[index].pending.clear();
+        if (!links[index].broken) {
+            links[index].broken = true;
+            broken_links.fetch_add(1);
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, PQsocket(links[index].conn), nullptr);
+        }
+    }
+
+    static PGconn* open_link(const std::string& conn_str, std::string& error) {
+        PGconn* conn = PQconnectdb(conn_str.c_str());
+        if (PQstatus(conn) != CONNECTION_OK) {
+            error = "Асинхронное подключение не установлено: " + std::string(PQerrorMessage(conn));
+        } else if (PQsetnonblocking(conn, 1) != 0 || PQenterPipelineMode(conn) != 1) {
+            error = "Не удалось включить конвейерный режим: " + std::string(PQerrorMessage(conn));
+        } else {
+            return conn;
+        }
+        PQfinish(conn);
+        return nullptr;
+    }
+
+    void dispatch() {
+        std::deque<Job> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch.swap(jobs);
+        }
+
+        for (auto& job : batch) {
+            size_t index = links.size();
+            for (size_t i = 0; i < links.size(); ++i) {
+                if (links[i].broken) continue;
+                if (index == links.size() || links[i].pending.size() < links[index].pending.size()) index = i;
+            }
+            if (index == links.size()) {
+                job.promise.set_exception(std::make_exception_ptr(std::runtime_error("Нет живых асинхронных соединений")));
+                continue;
+            }
+            Link& link = links[index];
+
+            std::vector<const char*> values;
+            for (const auto& param : job.params) {
+                values.push_back(param.c_str());
+            }
+            if (!PQsendQueryParams(link.conn, job.sql.c_str(), static_cast<int>(values.size()),
+                                   nullptr, values.data(), nullptr, nullptr, 0) ||
+                !PQpipelineSync(link.conn)) {
+                job.promise.set_exception(std::make_exception_ptr(
+                    std::runtime_error(std::string("Ошибка отправки запроса: ") + PQerrorMessage(link.conn))));
+                continue;
+            }
+            link.pending.push_back(Pending{std::move(job.promise), ResultTable(), "", false});
+        }
+
+        for (size_t i = 0; i < links.size(); ++i) {
+            if (!links[i].broken) flush(i);
+        }
+    }
+
+    static void append(ResultTable& table, PGresult* res) {
+        int fields = PQnfields(res);
+        if (table.columns.empty()) {
+            for (int j = 0; j < fields; ++j) {
+                table.columns.push_back(PQfname(res, j));
+            }
+        }
+        for (int i = 0; i < PQntuples(res); ++i) {
+            std::vector<std::optional<std::string>> row;
+            for (int j = 0; j < fields; ++j) {
+                row.push_back(PQgetisnull(res, i, j) ? std::nullopt
+                                                     : std::optional<std::string>(PQgetvalue(res, i, j)));
+            }
+            table.rows.push_back(row);
+        }
+    }
+
+    void receive(size_t index) {
+        Link& link = links[index];
+        if (!PQconsumeInput(link.conn)) {
+            failLink(index, std::string("Соединение потеряно: ") + PQerrorMessage(link.conn));
+            return;
+        }
+
+        while (!PQisBusy(link.conn)) {
+            PGresult* res = PQgetResult(link.conn);
+            if (!res) {
+                if (link.pending.empty() || !link.pending.front().got_result) break;
+                Pending& done = link.pending.front();
+                if (done.error.empty()) {
+                    done.promise.set_value(std::move(done.table));
+                } else {
+                    fail(done, done.error);
+                }
+                link.pending.pop_front();
+                continue;
+            }
+
+            ExecStatusType status = PQresultStatus(res);
+            if (status != PGRES_PIPELINE_SYNC && !link.pending.empty()) {
+                Pending& current = link.pending.front();
+                current.got_result = true;
+                if (status == PGRES_TUPLES_OK || status == PGRES_SINGLE_TUPLE) {
+                    append(current.table, res);
+                } else if (status == PGRES_PIPELINE_ABORTED) {
+                    current.error = "Запрос пропущен из-за ошибки в конвейере";
+                } else if (status != PGRES_COMMAND_OK) {
+                    current.error = PQresultErrorMessage(res);
+                }
+            }
+            PQclear(res);
+        }
+    }
+
+    void loop() {
+        epoll_event events[16];
+        while (true) {
+            int count = epoll_wait(epoll_fd, events, 16, -1);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("Ошибка epoll_wait: ") + std::strerror(errno));
+            }
+
+            for (int i = 0; i < count; ++i) {
+                if (events[i].data.u64 == links.size()) {
+                    uint64_t value;
+                    ssize_t ignored = read(wake_fd, &value, sizeof(value));
+                    (void)ignored;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (stopping) return;
+                    }
+                    dispatch();
+                    continue;
+                }
+
+                size_t index = static_cast<size_t>(events[i].data.u64);
+                if (links[index].broken) continue;
+                if (events[i].events & EPOLLOUT) {
+                    flush(index);
+                }
+                if (!links[index].broken && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+                    receive(index);
+                }
+            }
+        }
+    }
+
+    void run() {
+        try {
+            loop();
+        } catch (const std::exception &e) {
+            std::deque<Job> orphaned;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                loop_error = e.what();
+                orphaned.swap(jobs);
+            }
+            for (auto& job : orphaned) {
+                job.promise.set_exception(std::make_exception_ptr(std::runtime_error(e.what())));
+            }
+            for (size_t i = 0; i < links.size(); ++i) {
+                failLink(i, e.what());
+            }
+        }
+    }
+
+    void release() {
+        for (auto& link : links) {
+            PQfinish(link.conn);
+        }
+        links.clear();
+        if (epoll_fd >= 0) close(epoll_fd);
+        if (wake_fd >= 0) close(wake_fd);
+    }
+
+    void setUp(size_t connections) {
+        if (epoll_fd < 0 || wake_fd < 0) {
+            throw std::runtime_error(std::string("Не удалось создать epoll: ") + std::strerror(errno));
+        }
+        for (size_t i = 0; i < connections; ++i) {
+            std::string error;
+            PGconn* conn = open_link(conn_str, error);
+            if (!conn) {
+                throw std::runtime_error(error);
+            }
+            links.push_back(Link{conn, {}, false, false});
+        }
+
+        for (size_t i = 0; i <= links.size(); ++i) {
+            epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.u64 = i;
+            int fd = i < links.size() ? PQsocket(links[i].conn) : wake_fd;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                throw std::runtime_error(std::string("Ошибка epoll_ctl: ") + std::strerror(errno));
+            }
+        }
+    }
+
+public:
+    AsyncPg(const std::string& conn_string, size_t connections)
+        : conn_str(conn_string), epoll_fd(epoll_create1(EPOLL_CLOEXEC)), wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), stopping(false),
+          broken_links(0) {
+        try {
+            setUp(connections);
+        } catch (...) {
+            release();
+            throw;
+        }
+        loop_thread = std::thread(&AsyncPg::run, this);
+    }
+
+    ~AsyncPg() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+        loop_thread.join();
+
+        for (size_t i = 0; i < links.size(); ++i) {
+            failLink(i, "Асинхронный исполнитель остановлен");
+        }
+        for (auto& job : jobs) {
+            job.promise.set_exception(std::make_exception_ptr(std::runtime_error("Асинхронный исполнитель остановлен")));
+        }
+        release();
+    }
+
+    AsyncPg(const AsyncPg&) = delete;
+    AsyncPg& operator=(const AsyncPg&) = delete;
+
+    bool healthy() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return broken_links.load() == 0 && loop_error.empty();
+    }
+
+    std::vector<WatchedBackend> backends() const {
+        std::vector<WatchedBackend> watched;
+        for (const auto& link : links) {
+            watched.push_back(WatchedBackend{PQbackendPID(link.conn), PQsocket(link.conn)});
+        }
+        return watched;
+    }
+
+    std::future<ResultTable> submit(const std::string& sql, const std::vector<std::string>& params = {}) {
+        Job job{sql, params, std::promise<ResultTable>()};
+        std::future<ResultTable> result = job.promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!loop_error.empty()) {
+                job.promise.set_exception(std::make_exception_ptr(std::runtime_error(loop_error)));
+                return result;
+            }
+            jobs.push_back(std::move(job));
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+        return result;
+    }
+};
+
+struct ReaderCard {
+    int reader_id;
+    size_t open_loans;
+    size_t overdue;
+    long long fines_cents;
+    std::string last_activity;
+
+    bool operator==(const ReaderCard& other) const {
+        return reader_id == other.reader_id && open_loans == other.open_loans && overdue == other.overdue &&
+               fines_cents == other.fines_cents && last_activity == other.last_activity;
+    }
+};
+
+static long long to_cents(double amount) {
+    return std::llround(amount * 100);
+}
+
+static std::string format_cents(long long cents) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%s%lld.%02lld", cents < 0 ? "-" : "",
+                  std::llabs(cents) / 100, std::llabs(cents) % 100);
+    return buffer;
+}
+
+static std::string local_date_today() {
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+    localtime_r(&now, &local);
+    char buffer[16];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d", &local);
+    return buffer;
+}
+
+static ResultTable reader_cards_table(const std::vector<ReaderCard>& cards) {
+    ResultTable table;
+    table.columns = {"reader_id", "open_loans", "overdue", "fine_amount", "last_activity"};
+    for (const auto& card : cards) {
+        table.rows.push_back({
+            std::to_string(card.reader_id),
+            std::to_string(card.open_loans),
+            std::to_string(card.overdue),
+            format_cents(card.fines_cents),
+            card.last_activity.empty() ? std::nullopt : std::optional<std::string>(card.last_activity)
+        });
+    }
+    return table;
+}
+
+class XidSnapshot {
+private:
+    unsigned long long xmin;
+    unsigned long long xmax;
+    std::unordered_set<unsigned long long> in_progress;
+
+public:
+    XidSnapshot() : xmin(0), xmax(0) {}
+
+    static XidSnapshot parse(const std::string& text) {
+        XidSnapshot snapshot;
+        size_t first = text.find(':');
+        size_t second = text.find(':', first + 1);
+        if (first == std::string::npos || second == std::string::npos) {
+            throw std::runtime_error("Некорректный снимок транзакций: " + text);
+        }
+        snapshot.xmin = std::stoull(text.substr(0, first));
+        snapshot.xmax = std::stoull(text.substr(first + 1, second - first - 1));
+
+        std::stringstream xip(text.substr(second + 1));
+        std::string xid;
+        while (std::getline(xip, xid, ',')) {
+            if (!xid.empty()) snapshot.in_progress.insert(std::stoull(xid));
+        }
+        return snapshot;
+    }
+
+    bool visible(unsigned long long xid) const {
+        if (xid < xmin) return true;
+        if (xid >= xmax) return false;
+        return in_progress.count(xid) == 0;
+    }
+};
+
+struct SummaryCheck {
+    size_t checked;
+    size_t busy;
+    std::vector<std::pair<ReaderCard, ReaderCard>> mismatches;
+    std::set<size_t> shards;
+};
+
+class ReaderSummaries {
+private:
+    static constexpr size_t stripe_count = 16;
+    static constexpr size_t recent_events = 32;
+
+    struct Applied {
+        unsigned long long seq;
+        unsigned long long xid;
+    };
+
+    struct Summary {
+        std::vector<std::map<int, std::string>> open_due;
+        std::vector<long long> fines_cents;
+        std::vector<std::string> last_activity;
+        std::vector<std::deque<Applied>> recent;
+        std::vector<unsigned long long> evicted_seq;
+    };
+
+    struct Stripe {
+        std::mutex mutex;
+        std::unordered_map<int, Summary> readers;
+    };
+
+    class Receiver : public pqxx::notification_receiver {
+    private:
+        std::vector<std::string>& pending;
+        int own_pid;
+
+    public:
+        Receiver(pqxx::connection& conn, const std::string& channel, std::vector<std::string>& payloads,
+                 bool own_only = false)
+            : pqxx::notification_receiver(conn, channel), pending(payloads),
+              own_pid(own_only ? conn.backendpid() : 0) {}
+
+        void operator()(const std::string& payload, int backend_pid) override {
+            if (own_pid == 0 || backend_pid == own_pid) {
+                pending.push_back(payload);
+            }
+        }
+    };
+
+    std::vector<ShardConfig> shard_configs;
+    std::array<Stripe, stripe_count> stripes;
+    std::vector<std::atomic<bool>> ready;
+    std::vector<std::atomic<bool>> reload_requested;
+    std::vector<std::atomic<unsigned long long>> applied_seq;
+    std::vector<std::atomic<unsigned long long>> generation;
+    std::vector<std::atomic<long>> mark_requested;
+    std::vector<long> mark_reached;
+    std::mutex mark_mutex;
+    std::condition_variable mark_cv;
+    long next_mark;
+    std::atomic<bool> stopping;
+    std::vector<std::thread> feeds;
+
+    Stripe& stripe_for(int reader_id) {
+        return stripes[static_cast<size_t>(reader_id) % stripe_count];
+    }
+
+    Summary& summaryFor(Stripe& stripe, int reader_id) {
+        Summary& summary = stripe.readers[reader_id];
+        if (summary.fines_cents.empty()) {
+            summary.open_due.resize(shard_configs.size());
+            summary.fines_cents.assign(shard_configs.size(), 0);
+            summary.last_activity.assign(shard_configs.size(), "");
+            summary.recent.resize(shard_configs.size());
+            summary.evicted_seq.assign(shard_configs.size(), 0);
+        }
+        return summary;
+    }
+
+    static void bump(std::string& last_activity, const std::string& date) {
+        if (date > last_activity) last_activity = date;
+    }
+
+    static ReaderCard shardCard(int reader_id, const Summary& summary, size_t shard, const std::string& today) {
+        ReaderCard card{reader_id, summary.open_due[shard].size(), 0, summary.fines_cents[shard],
+                        summary.last_activity[shard]};
+        for (const auto& loan : summary.open_due[shard]) {
+            if (loan.second < today) ++card.overdue;
+        }
+        return card;
+    }
+
+    static void add(ReaderCard& total, const ReaderCard& part) {
+        total.open_loans += part.open_loans;
+        total.overdue += part.overdue;
+        total.fines_cents += part.fines_cents;
+        bump(total.last_activity, part.last_activity);
+    }
+
+    ReaderCard cardOf(int reader_id, const Summary& summary, const std::string& today) const {
+        ReaderCard card{reader_id, 0, 0, 0, ""};
+        for (size_t i = 0; i < summary.fines_cents.size(); ++i) {
+            add(card, shardCard(reader_id, summary, i, today));
+        }
+        return card;
+    }
+
+    static bool changedSince(const Summary& summary, size_t shard, unsigned long long seq,
+                             const XidSnapshot& snapshot) {
+        if (summary.evicted_seq[shard] > seq) return true;
+        for (const auto& applied : summary.recent[shard]) {
+            if (applied.seq > seq && !snapshot.visible(applied.xid)) return true;
+        }
+        return false;
+    }
+
+    void dropShard(size_t shard) {
+        for (auto& stripe : stripes) {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            for (auto& reader : stripe.readers) {
+                Summary& summary = reader.second;
+                summary.open_due[shard].clear();
+                summary.fines_cents[shard] = 0;
+                summary.last_activity[shard].clear();
+                summary.recent[shard].clear();
+                summary.evicted_seq[shard] = 0;
+            }
+        }
+    }
+
+    XidSnapshot loadShard(pqxx::connection& conn, size_t shard) {
+        generation[shard].fetch_add(1);
+        dropShard(shard);
+
+        pqxx::work txn(conn);
+        txn.exec("SET TRANSACTION ISOLATION LEVEL REPEATABLE READ, READ ONLY");
+        XidSnapshot snapshot = XidSnapshot::parse(txn.exec("SELECT pg_current_snapshot()::text")[0][0].c_str());
+        pqxx::result open = txn.exec(LibrarySql::open_loans_by_reader());
+        pqxx::result totals = txn.exec(LibrarySql::reader_loan_totals());
+        txn.commit();
+
+        for (const auto& row : open) {
+            int reader_id = row["reader_id"].as<int>();
+            Stripe& stripe = stripe_for(reader_id);
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            summaryFor(stripe, reader_id).open_due[shard][row["loan_id"].as<int>()] = row["due_date"].c_str();
+        }
+        for (const auto& row : totals) {
+            int reader_id = row["reader_id"].as<int>();
+            Stripe& stripe = stripe_for(reader_id);
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            Summary& summary = summaryFor(stripe, reader_id);
+            summary.fines_cents[shard] = to_cents(row["fine_amount"].as<double>());
+            summary.last_activity[shard] = row["last_activity"].is_null() ? "" : row["last_activity"].c_str();
+        }
+        return snapshot;
+    }
+
+    void applyEvent(size_t shard, const std::string& payload, const XidSnapshot& snapshot) {
+        JsonValue event = JsonValue::parse(payload);
+        unsigned long long xid = std::stoull(event.get_string("xid", "0"));
+        if (snapshot.visible(xid)) return;
+
+        std::string op = event.get_string("op");
+        int reader_id = static_cast<int>(event.get_number("reader_id"));
+        int loan_id = static_cast<int>(event.get_number("loan_id"));
+        Stripe& stripe = stripe_for(reader_id);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        Summary& summary = summaryFor(stripe, reader_id);
+
+        if (op == "issue") {
+            summary.open_due[shard][loan_id] = event.get_string("due_date");
+            bump(summary.last_activity[shard], event.get_string("loan_date"));
+        } else if (op == "return") {
+            summary.open_due[shard].erase(loan_id);
+            summary.fines_cents[shard] += to_cents(event.get_number("fine_amount"));
+            bump(summary.last_activity[shard], event.get_string("return_date"));
+        }
+
+        auto& recent = summary.recent[shard];
+        recent.push_back(Applied{applied_seq[shard].fetch_add(1) + 1, xid});
+        if (recent.size() > recent_events) {
+            summary.evicted_seq[shard] = recent.front().seq;
+            recent.pop_front();
+        }
+    }
+
+    void reachMark(size_t shard, const std::string& payload) {
+        {
+            std::lock_guard<std::mutex> lock(mark_mutex);
+            mark_reached[shard] = std::max(mark_reached[shard], std::stol(payload));
+        }
+        mark_cv.notify_all();
+    }
+
+    void feedLoop(size_t shard) {
+        while (!stopping) {
+            try {
+                pqxx::connection conn(shard_configs[shard].conn_str);
+                std::vector<std::string> pending;
+                std::vector<std::string> marks;
+                Receiver receiver(conn, "loan_events", pending);
+                Receiver mark_receiver(conn, "loan_events_mark", marks, true);
+                long mark_sent = 0;
+
+                reload_requested[shard] = false;
+                XidSnapshot snapshot = loadShard(conn, shard);
+                ready[shard] = true;
+
+                while (!stopping) {
+                    conn.await_notification(0, 100000);
+                    for (const auto& payload : pending) {
+                        try {
+                            applyEvent(shard, payload, snapshot);
+                        } catch (const std::exception &e) {
+                            std::cerr << "Некорректное событие выдачи: " << payload << std::endl;
+                        }
+                    }
+                    pending.clear();
+                    for (const auto& payload : marks) {
+                        reachMark(shard, payload);
+                    }
+                    marks.clear();
+
+                    long requested = mark_requested[shard].load();
+                    if (requested > mark_sent) {
+                        pqxx::nontransaction txn(conn);
+                        txn.exec_params("SELECT pg_notify('loan_events_mark', $1)", std::to_string(requested));
+                        mark_sent = requested;
+                    }
+
+                    if (reload_requested[shard].exchange(false)) {
+                        ready[shard] = false;
+                        snapshot = loadShard(conn, shard);
+                        ready[shard] = true;
+                    }
+                }
+            } catch (const std::exception &e) {
+                ready[shard] = false;
+                std::cerr << "Лента изменений филиала " << shard_configs[shard].branch
+                          << " прервана: " << e.what() << std::endl;
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+        }
+    }
+
+    void catchUp(std::chrono::milliseconds timeout) {
+        long token;
+        {
+            std::lock_guard<std::mutex> lock(mark_mutex);
+            token = ++next_mark;
+        }
+        for (auto& requested : mark_requested) {
+            requested = token;
+        }
+
+        std::unique_lock<std::mutex> lock(mark_mutex);
+        bool reached = mark_cv.wait_for(lock, timeout, [this, token]() {
+            for (long mark : mark_reached) {
+                if (mark < token) return false;
+            }
+            return true;
+        });
+        if (!reached) {
+            throw std::runtime_error("Лента изменений не догнала снимок проверки");
+        }
+    }
+
+public:
+    explicit ReaderSummaries(const std::vector<ShardConfig>& configs)
+        : shard_configs(configs), ready(configs.size()), reload_requested(configs.size()),
+          applied_seq(configs.size()), generation(configs.size()), mark_requested(configs.size()),
+          mark_reached(configs.size(), 0), next_mark(0), stopping(false) {
+        for (size_t i = 0; i < shard_configs.size(); ++i) {
+            feeds.emplace_back(&ReaderSummaries::feedLoop, this, i);
+        }
+    }
+
+    ~ReaderSummaries() {
+        stopping = true;
+        for (auto& feed : feeds) {
+            feed.join();
+        }
+    }
+
+    bool is_ready() const {
+        for (const auto& shard_ready : ready) {
+            if (!shard_ready) return false;
+        }
+        return true;
+    }
+
+    bool wait_ready(std::chrono::milliseconds timeout) const {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!is_ready()) {
+            if (std::chrono::steady_clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return true;
+    }
+
+    void reload() {
+        for (auto& flag : reload_requested) {
+            flag = true;
+        }
+    }
+
+    void reload(size_t shard) {
+        reload_requested[shard] = true;
+    }
+
+    ReaderCard card(int reader_id, const std::string& today) {
+        if (!is_ready()) {
+            throw std::runtime_error("Сводки читателей еще загружаются");
+        }
+        Stripe& stripe = stripe_for(reader_id);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto found = stripe.readers.find(reader_id);
+        if (found == stripe.readers.end()) {
+            return ReaderCard{reader_id, 0, 0, 0, ""};
+        }
+        return cardOf(reader_id, found->second, today);
+    }
+
+    SummaryCheck check(const std::function<std::vector<ResultTable>()>& fetch_truth,
+                       std::chrono::milliseconds timeout) {
+        if (!is_ready()) {
+            throw std::runtime_error("Сводки читателей еще загружаются");
+        }
+        std::vector<unsigned long long> seq_before, generation_before;
+        for (size_t shard = 0; shard < shard_configs.size(); ++shard) {
+            seq_before.push_back(applied_seq[shard].load());
+            generation_before.push_back(generation[shard].load());
+        }
+
+        std::vector<ResultTable> truth_parts = fetch_truth();
+        catchUp(timeout);
+        for (size_t shard = 0; shard < shard_configs.size(); ++shard) {
+            if (generation[shard].load() != generation_before[shard]) {
+                throw std::runtime_error("Сводки перечитывались во время проверки, повторите ее");
+            }
+        }
+
+        std::string today = local_date_today();
+        std::vector<XidSnapshot> snapshots;
+        std::vector<std::map<int, ReaderCard>> truth(truth_parts.size());
+        std::set<int> reader_ids;
+        for (size_t shard = 0; shard < truth_parts.size(); ++shard) {
+            const auto& rows = truth_parts[shard].rows;
+            if (rows.empty()) {
+                throw std::runtime_error("Нет снимка проверки для филиала " + shard_configs[shard].branch);
+            }
+            snapshots.push_back(XidSnapshot::parse(rows.front()[6].value_or("")));
+            today = rows.front()[5].value_or(today);
+            for (const auto& row : rows) {
+                if (!row[0]) continue;
+                int reader_id = std::stoi(*row[0]);
+                truth[shard][reader_id] = ReaderCard{
+                    reader_id, std::stoul(row[1].value_or("0")), std::stoul(row[2].value_or("0")),
+                    to_cents(std::stod(row[3].value_or("0"))), row[4].value_or("")
+                };
+                reader_ids.insert(reader_id);
+            }
+        }
+        for (auto& stripe : stripes) {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            for (const auto& reader : stripe.readers) {
+                reader_ids.insert(reader.first);
+            }
+        }
+
+        SummaryCheck result{0, 0, {}, {}};
+        for (int reader_id : reader_ids) {
+            Stripe& stripe = stripe_for(reader_id);
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            auto found = stripe.readers.find(reader_id);
+
+            bool busy = false;
+            std::set<size_t> differing;
+            ReaderCard cached{reader_id, 0, 0, 0, ""};
+            ReaderCard expected{reader_id, 0, 0, 0, ""};
+            for (size_t shard = 0; shard < truth.size(); ++shard) {
+                ReaderCard shard_cached{reader_id, 0, 0, 0, ""};
+                if (found != stripe.readers.end()) {
+                    if (changedSince(found->second, shard, seq_before[shard], snapshots[shard])) busy = true;
+                    shard_cached = shardCard(reader_id, found->second, shard, today);
+                }
+                auto it = truth[shard].find(reader_id);
+                ReaderCard shard_expected = it != truth[shard].end() ? it->second : ReaderCard{reader_id, 0, 0, 0, ""};
+                if (!(shard_cached == shard_expected)) differing.insert(shard);
+                add(cached, shard_cached);
+                add(expected, shard_expected);
+            }
+
+            if (busy) {
+                ++result.busy;
+                continue;
+            }
+            ++result.checked;
+            if (!differing.empty()) {
+                result.mismatches.emplace_back(cached, expected);
+                result.shards.insert(differing.begin(), differing.end());
+            }
+        }
+        return result;
+    }
+};
 
 class LibraryDB {
 private:
+    struct Shard {
+        std::string branch;
+        std::string conn_str;
+        pqxx::connection* conn;
+        std::unique_ptr<HoldQueues> hold_queues;
+        std::unique_ptr<AsyncPg> async;
+    };
+
+    std::vector<Shard> shards;
+    pqxx::connection* conn;
+    int hold_pickup_days;
+    int hold_wait_days;
+    QueryWatchdog watchdog;
+    OpLimits interactive_limits;
+    OpLimits report_limits;
+    OpLimits write_limits;
+    std::unique_ptr<ReaderSummaries> summaries;
+
+    const OpLimits& limitsFor(OpClass op_class) const {
+        switch (op_class) {
+            case OpClass::Report: return report_limits;
+            case OpClass::Write: return write_limits;
+            default: return interactive_limits;
+        }
+    }
+
+    void printTable(const ResultTable& table) {
+        if (table.rows.empty()) {
+            std::cout << "Нет данных" << std::endl;
+            return;
+        }
+
+        for (size_t i = 0; i < table.rows.size(); ++i) {
+            const auto& row = table.rows[i];
+            std::cout << "\n--- Запись " << (i + 1) << " ---" << std::endl;
+
+            for (size_t j = 0; j < row.size(); ++j) {
+                const std::string& col_name = table.columns[j];
+                std::string value = row[j] ? *row[j] : "Нет данных";
+
+                std::string display_name = col_name;
+                if (col_name == "genre") display_name = "Жанр";
+                else if (col_name == "title") display_name = "Название";
+                else if (col_name == "published_year") display_name = "Год";
+                else if (col_name == "language") display_name = "Язык";
+                else if (col_name == "is_reference") display_name = "Справочное";
+                else if (col_name == "full_name") display_name = "ФИО";
+                else if (col_name == "country") display_name = "Страна";
+                else if (col_name == "book_count") display_name = "Книг";
+                else if (col_name == "author_count") display_name = "Авторов";
+                else if (col_name == "inventory_number") display_name = "Инвентарный номер";
+                else if (col_name == "location") display_name = "Местоположение";
+                else if (col_name == "status") display_name = "Статус";
+                else if (col_name == "loan_date") display_name = "Дата выдачи";
+                else if (col_name == "due_date") display_name = "Срок возврата";
+                else if (col_name == "return_date") display_name = "Дата возврата";
+                else if (col_name == "fine_amount") display_name = "Штраф";
+                else if (col_name == "days_overdue") display_name = "Дней просрочки";
+                else if (col_name == "loan_count") display_name = "Выдач";
+                else if (col_name == "reader") display_name = "Читатель";
+                else if (col_name == "book") display_name = "Книга";
+                else if (col_name == "branch") display_name = "Филиал";
+                else if (col_name == "reader_id") display_name = "ID читателя";
+                else if (col_name == "open_loans") display_name = "Открытых выдач";
+                else if (col_name == "overdue") display_name = "Просрочено";
+                else if (col_name == "last_activity") display_name = "Последняя активность";
+
+                std::cout << std::left << std::setw(30) << display_name + ":" << value << std::endl;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    void printResult(const pqxx::result& res) {
+        printTable(ResultTable::from_result(res));
+    }
+
+    void clearLine() {
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+
+    size_t shardForId(int id) const {
+        return shard_for_id(id, shards.size());
+    }
+
+    size_t shardForBranch(const std::string& branch) const {
+        if (branch.empty()) return 0;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            if (shards[i].branch == branch) return i;
+        }
+        throw std::runtime_error("Неизвестный филиал: " + branch);
+    }
+
+    void addBranchColumn(ResultTable& table, size_t shard) const {
+        if (shards.size() < 2) return;
+        add_branch_column(table, shards[shard].branch);
+    }
+
+    AsyncPg& asyncFor(size_t shard) {
+        if (shards[shard].async && !shards[shard].async->healthy()) {
+            shards[shard].async.reset();
+        }
+        if (!shards[shard].async) {
+            size_t connections = static_cast<size_t>(std::stoi(get_env_or_default("ASYNC_CONNECTIONS", "3")));
+            shards[shard].async = std::make_unique<AsyncPg>(
+                shards[shard].conn_str + " options='-c statement_timeout=" +
+                std::to_string(report_limits.statement_ms) + " -c lock_timeout=" +
+                std::to_string(report_limits.lock_ms) + "'",
+                connections);
+        }
+        return *shards[shard].async;
+    }
+
+    ReaderSummaries& readerSummaries() {
+        if (!summaries) {
+            std::vector<ShardConfig> configs;
+            for (const auto& shard : shards) {
+                configs.push_back(ShardConfig{shard.branch, shard.conn_str});
+            }
+            summaries = std::make_unique<ReaderSummaries>(configs);
+        }
+        return *summaries;
+    }
+
+    std::vector<ResultTable> scatter(const std::string& sql, OpClass op_class, bool with_branch) {
+        std::vector<pqxx::connection*> conns;
+        for (const auto& shard : shards) {
+            conns.push_back(shard.conn);
+        }
+
+        std::vector<ResultTable> parts = scatter_query(conns, watchdog, limitsFor(op_class), sql);
+        if (with_branch) {
+            for (size_t i = 0; i < parts.size(); ++i) {
+                addBranchColumn(parts[i], i);
+            }
+        }
+        return parts;
+    }
+
+    void replicateRow(const std::string& table, const std::string& key, const pqxx::result& rows) {
+        std::vector<pqxx::connection*> replicas;
+        for (size_t i = 1; i < shards.size(); ++i) {
+            replicas.push_back(shards[i].conn);
+        }
+        replicate_rows(*shards.front().conn, replicas, watchdog, limitsFor(OpClass::Write), table, key, rows);
+    }
+
+    std::pair<size_t, size_t> holdPosition(size_t shard, int book_id, int reader_id) {
+        HoldQueues& hold_queues = *shards[shard].hold_queues;
+        if (!hold_queues.is_fresh(book_id)) {
+            pqxx::connection& shard_conn = *shards[shard].conn;
+            BoundedOperation op(watchdog, shard_conn, limitsFor(OpClass::Interactive));
+            pqxx::work txn(shard_conn);
+            op.apply(txn);
+            std::vector<HoldEntry> entries = load_waiting_holds(txn, book_id);
+            txn.commit();
+            hold_queues.replace(book_id, entries);
+        }
+        return hold_queues.position(book_id, reader_id);
+    }
+
+    void printAssignedHold(size_t shard, const pqxx::result& assigned) {
+        if (assigned.empty()) return;
+        shards[shard].hold_queues->erase(assigned[0]["book_id"].as<int>(), assigned[0]["hold_id"].as<int>());
+        std::cout << "Экземпляр забронирован для читателя reader_id = " << assigned[0]["reader_id"].c_str()
+                  << " (hold_id = " << assigned[0]["hold_id"].c_str()
+                  << "), получить до " << assigned[0]["expires_at"].c_str() << std::endl;
+    }
+
+public:
+    LibraryDB(const std::vector<ShardConfig>& shard_configs)
+        : conn(nullptr),
+          hold_pickup_days(std::stoi(get_env_or_default("HOLD_PICKUP_DAYS", "3"))),
+          hold_wait_days(std::stoi(get_env_or_default("HOLD_WAIT_DAYS", "30"))),
+          watchdog(shard_configs.front().conn_str),
+          interactive_limits(op_limits_from_env("TIMEOUT_INTERACTIVE_MS", "5000", "LOCK_TIMEOUT_INTERACTIVE_MS", "2000")),
+          report_limits(op_limits_from_env("TIMEOUT_REPORT_MS", "30000", "LOCK_TIMEOUT_REPORT_MS", "5000")),
+          write_limits(op_limits_from_env("TIMEOUT_WRITE_MS", "10000", "LOCK_TIMEOUT_WRITE_MS", "2000")) {
+        std::chrono::seconds refresh(std::stoi(get_env_or_default("HOLD_QUEUE_REFRESH_SECONDS", "5")));
+        for (const auto& config : shard_configs) {
+            shards.push_back(Shard{config.branch, config.conn_str, connect_with_retry(config.conn_str),
+                                   std::make_unique<HoldQueues>(refresh), nullptr});
+        }
+        conn = shards.front().conn;
+    }
+
+    ~LibraryDB() {
+        for (auto& shard : shards) {
+            delete shard.conn;
+        }
+    }
+
+    void restore_connections() {
+        for (auto& shard : shards) {
+            if (shard.conn->is_open()) continue;
+            std::cerr << "Соединение с БД потеряно, переподключение..." << std::endl;
+            delete shard.conn;
+            shard.conn = connect_with_retry(shard.conn_str);
+        }
+        conn = shards.front().conn;
+    }
+
+    size_t shard_count() const {
+        return shards.size();
+    }
+
+    void execute(const std::string& sql, OpClass op_class = OpClass::Write) {
+        try {
+            BoundedOperation op(watchdog, *conn, limitsFor(op_class));
+            pqxx::work txn(*conn);
+            op.apply(txn);
+            txn.exec(sql);
+            txn.commit();
+        } catch (const pqxx::query_canceled &e) {
+            std::cerr << "Запрос отменен (таймаут или Ctrl-C): " << e.what() << std::endl;
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    pqxx::result query(const std::string& sql, OpClass op_class = OpClass::Interactive) {
+        try {
+            BoundedOperation op(watchdog, *conn, limitsFor(op_class));
+            pqxx::work txn(*conn);
+            op.apply(txn);
+            pqxx::result res = txn.exec(sql);
+            txn.commit();
+            return res;
+        } catch (const pqxx::query_canceled &e) {
+            std::cerr << "Запрос отменен (таймаут или Ctrl-C): " << e.what() << std::endl;
+            throw;
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка запроса: " << e.what() << std::endl;
+            throw;
+        }
+    }
+
+    void query1_books_by_genre(const std::string& genre) {
+        std::string sql = LibrarySql::books_by_genre(genre);
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "1. Книги жанра: " << genre << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        try {
+            auto res = query(sql);
+            printResult(res);
+        } catch (...) {}
+    }
+
+    void query2_books_with_multiple_authors() {
+        std::string sql = LibrarySql::books_with_multiple_authors();
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "2. Книги с несколькими авторами" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        try {
+            auto res = query(sql, OpClass::Report);
+            printResult(res);
+        } catch (...) {}
+    }
+
+    void query3_authors_book_count() {
+        std::string sql = LibrarySql::authors_book_count();
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "3. Авторы и количество книг" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        try {
+            auto res = query(sql, OpClass::Report);
+            printResult(res);
+        } catch (...) {}
+    }
+
+    void query4_available_copies_by_title(const std::string& title) {
+        std::string sql = LibrarySql::available_copies_by_title(title);
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "4. Доступные экземпляры: " << title << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        try {
+            printTable(merge_sorted(scatter(sql, OpClass::Interactive, true), ReportOrder::available_copies()));
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка запроса: " << e.what() << std::endl;
+        }
+    }
+
+    void query5_active_loans() {
+        std::string sql = LibrarySql::active_loans();
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "5. Текущие выдачи" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        try {
+            printTable(merge_sorted(scatter(sql, OpClass::Report, true), ReportOrder::active_loans()));
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка запроса: " << e.what() << std::endl;
+        }
+    }
+
+    void query6_overdue_loans() {
+        std::string sql = LibrarySql::overdue_loans();
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "6. Просроченные выдачи" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        try {
+            printTable(merge_sorted(scatter(sql, OpClass::Report, true), ReportOrder::overdue_loans()));
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка запроса: " << e.what() << std::endl;
+        }
+    }
+
+    void query7_popular_genres() {
+        std::string sql = LibrarySql::popular_genres();
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "7. Популярные жанры (по выдачам)" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        try {
+            printTable(combine_counts(scatter(sql, OpClass::Report, false), 0, 1));
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка запроса: " << e.what() << std::endl;
+        }
+    }
+
+    void query8_return_book(int loan_id) {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "8. Возврат книги (loan_id = " << loan_id << ")" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        try {
+            size_t shard = shardForId(loan_id);
+            pqxx::connection& shard_conn = *shards[shard].conn;
+            BoundedOperation op(watchdog, shard_conn, limitsFor(OpClass::Write));
+            pqxx::work txn(shard_conn);
+            op.apply(txn);
+            ReturnOutcome outcome = LoanOps::return_loan(txn, loan_id, hold_pickup_days);
+            txn.commit();
+
+            if (!outcome.found) {
+                std::cout << "Выдача не найдена или уже закрыта" << std::endl;
+                return;
+            }
+            printResult(outcome.info);
+            printAssignedHold(shard, outcome.assigned);
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    void query9_add_reader() {
+        std::string full_name, group, email, status;
+
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "9. Добавление читателя" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        std::cout << "ФИО: ";
+        clearLine();
+        std::getline(std::cin, full_name);
+        std::cout << "Группа (опционально): ";
+        std::getline(std::cin, group);
+        std::cout << "Email (опционально): ";
+        std::getline(std::cin, email);
+        std::cout << "Статус (active/inactive), по умолчанию active: ";
+        std::getline(std::cin, status);
+        if (status.empty()) {
+            status = "active";
+        }
+
+        try {
+            pqxx::result res;
+            pqxx::result full;
+            {
+                BoundedOperation op(watchdog, *conn, limitsFor(OpClass::Write));
+                pqxx::work txn(*conn);
+                op.apply(txn);
+                std::string sql = LibrarySql::insert_reader(txn, full_name, group, email, status);
+                res = txn.exec(sql);
+                full = txn.exec_params("SELECT * FROM readers WHERE reader_id = $1", res[0]["reader_id"].as<int>());
+                txn.commit();
+            }
+            replicateRow("readers", "reader_id", full);
+            printResult(res);
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    void query10_issue_loan(int reader_id, int copy_id, const std::string& due_date) {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "10. Выдать книгу" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        try {
+            size_t shard = shardForId(copy_id);
+            pqxx::connection& shard_conn = *shards[shard].conn;
+            BoundedOperation op(watchdog, shard_conn, limitsFor(OpClass::Write));
+            pqxx::work txn(shard_conn);
+            op.apply(txn);
+            IssueOutcome outcome = LoanOps::issue_loan(txn, reader_id, copy_id, due_date,
+                                                       hold_wait_days, hold_pickup_days);
+            txn.commit();
+
+            if (outcome.status == IssueOutcome::Status::NotFound) {
+                std::cout << "Экземпляр не найден" << std::endl;
+                return;
+            }
+
+            if (outcome.status == IssueOutcome::Status::Queued) {
+                std::cout << "Экземпляр недоступен (status = " << outcome.copy_status << ")" << std::endl;
+                printAssignedHold(shard, outcome.assigned);
+                if (!outcome.hold.empty()) {
+                    shards[shard].hold_queues->push(outcome.book_id, HoldEntry{
+                        outcome.hold[0]["created_us"].as<long long>(), outcome.hold[0]["hold_id"].as<int>(), reader_id
+                    });
+                }
+                auto position = holdPosition(shard, outcome.book_id, reader_id);
+                if (position.first > 0) {
+                    std::cout << "Читатель в очереди на книгу \"" << outcome.title
+                              << "\": позиция " << position.first << " из " << position.second << std::endl;
+                }
+                return;
+            }
+
+            shards[shard].hold_queues->invalidate(outcome.book_id);
+            std::cout << "Выдача создана. loan_id = " << outcome.loan_id << std::endl;
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    void query11_place_hold(int reader_id, int book_id, const std::string& branch) {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "11. Бронирование книги" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        try {
+            size_t shard = shardForBranch(branch);
+            pqxx::connection& shard_conn = *shards[shard].conn;
+            BoundedOperation op(watchdog, shard_conn, limitsFor(OpClass::Write));
+            pqxx::work txn(shard_conn);
+            op.apply(txn);
+            pqxx::result free_copy = txn.exec_params(LibrarySql::in_stock_copy(), book_id);
+            if (!free_copy.empty()) {
+                txn.commit();
+                std::cout << "Бронь не нужна: экземпляр " << free_copy[0]["inventory_number"].c_str()
+                          << " (copy_id = " << free_copy[0]["copy_id"].c_str() << ") есть в наличии" << std::endl;
+                return;
+            }
+            pqxx::result hold = txn.exec_params(LibrarySql::place_hold(), book_id, reader_id, hold_wait_days);
+            txn.commit();
+
+            if (hold.empty()) {
+                std::cout << "Читатель уже стоит в очереди на эту книгу" << std::endl;
+            } else {
+                shards[shard].hold_queues->push(book_id, HoldEntry{
+                    hold[0]["created_us"].as<long long>(), hold[0]["hold_id"].as<int>(), reader_id
+                });
+                std::cout << "Бронь создана. hold_id = " << hold[0]["hold_id"].c_str() << std::endl;
+            }
+
+            auto position = holdPosition(shard, book_id, reader_id);
+            if (position.first > 0) {
+                std::cout << "Позиция в очереди: " << position.first << " из " << position.second << std::endl;
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    void query12_hold_position(int reader_id, int book_id, const std::string& branch) {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "12. Позиция в очереди" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        try {
+            auto position = holdPosition(shardForBranch(branch), book_id, reader_id);
+            if (position.first == 0) {
+                std::cout << "Читатель не стоит в очереди (ожидающих: " << position.second << ")" << std::endl;
+            } else {
+                std::cout << "Позиция в очереди: " << position.first << " из " << position.second << std::endl;
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    void query13_expire_holds() {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "13. Обработка просроченных броней" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        for (size_t shard = 0; shard < shards.size(); ++shard) {
+            try {
+                pqxx::connection& shard_conn = *shards[shard].conn;
+                BoundedOperation op(watchdog, shard_conn, limitsFor(OpClass::Write));
+                pqxx::work txn(shard_conn);
+                op.apply(txn);
+                HoldSweep sweep = LoanOps::expire_holds(txn, hold_pickup_days);
+                txn.commit();
+
+                for (const auto& row : sweep.waiting) {
+                    shards[shard].hold_queues->invalidate(row["book_id"].as<int>());
+                }
+                if (shards.size() > 1) {
+                    std::cout << "Филиал: " << shards[shard].branch << std::endl;
+                }
+                std::cout << "Истекло ожидающих броней: " << sweep.waiting.size() << std::endl;
+                std::cout << "Истекло неполученных броней: " << sweep.ready.size() << std::endl;
+                for (const auto& assigned : sweep.reassigned) {
+                    printAssignedHold(shard, assigned);
+                }
+            } catch (const std::exception &e) {
+                std::cerr << "Ошибка: " << e.what() << std::endl;
+            }
+        }
+    }
+
+    void injection1_vulnerable_login() {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "SQL-инъекция 1: Уязвимый логин" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        std::cout << "Уязвимый запрос:" << std::endl;
+        std::cout << "SELECT * FROM readers WHERE email = '$email' AND status = '$status'" << std::endl;
+        std::cout << "\nАтака:" << std::endl;
+        std::cout << "Email: any' OR '1'='1" << std::endl;
+        std::cout << "Status: любой" << std::endl;
+        std::cout << "\nИтоговый SQL:" << std::endl;
+        std::cout << "SELECT * FROM readers WHERE email = 'any' OR '1'='1' AND status = 'любой'" << std::endl;
+        std::cout << "\nРезультат: выдаст всех читателей" << std::endl;
+    }
+
+    void injection2_vulnerable_search() {
+        std::string search = "%' OR '1'='1";
+        std::string sql = "SELECT * FROM books WHERE title LIKE '%" + search + "%'";
+
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "SQL-инъекция 2: Уязвимый поиск" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        std::cout << "Пользовательский ввод: " << search << std::endl;
+        std::cout << "\nСформированный SQL:" << std::endl;
+        std::cout << sql << std::endl;
+        std::cout << "\nРезультат: покажет ВСЕ книги" << std::endl;
+
+        try {
+            auto res = query(sql);
+            std::cout << "\nНайдено записей: " << res.size() << std::endl;
+        } catch (...) {}
+    }
+
+    void injection3_union_attack() {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "SQL-инъекция 3: UNION-атака" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        std::cout << "Уязвимый запрос:" << std::endl;
+        std::cout << "SELECT title, published_year FROM books WHERE book_id = $id" << std::endl;
+        std::cout << "\nАтака (id):" << std::endl;
+        std::cout << "1 UNION SELECT full_name, 0 FROM readers" << std::endl;
+        std::cout << "\nИтоговый SQL:" << std::endl;
+        std::cout << "SELECT title, published_year FROM books WHERE book_id = 1 UNION SELECT full_name, 0 FROM readers" << std::endl;
+        std::cout << "\nРезультат: получаем список читателей" << std::endl;
+    }
+
+    void injection4_error_based() {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "SQL-инъекция 4: Error-based" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        std::cout << "Уязвимый запрос:" << std::endl;
+        std::cout << "SELECT * FROM books WHERE book_id = $id" << std::endl;
+        std::cout << "\nАтака (id):" << std::endl;
+        std::cout << "1 AND 1=CAST((SELECT version()) AS INT)" << std::endl;
+        std::cout << "\nРезультат: ошибка БД покажет версию PostgreSQL" << std::endl;
+    }
+
+    void injection5_time_based() {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "SQL-инъекция 5: Time-based (Blind)" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+        std::cout << "Уязвимый запрос:" << std::endl;
+        std::cout << "SELECT * FROM readers WHERE email = '$email'" << std::endl;
+        std::cout << "\nАтака (email):" << std::endl;
+        std::cout << "test' AND (SELECT pg_sleep(5))--" << std::endl;
+        std::cout << "\nРезультат: если ответ задерживается 5 сек, значит запись существует" << std::endl;
+    }
+
+    void safe_search_books(const std::string& search_term) {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "Безопасный поиск книги" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        try {
+            BoundedOperation op(watchdog, *conn, limitsFor(OpClass::Interactive));
+            pqxx::work txn(*conn);
+            op.apply(txn);
+            pqxx::result res = txn.exec_params(LibrarySql::search_books(), "%" + search_term + "%");
+            txn.commit();
+
+            std::cout << "Поиск: " << search_term << std::endl;
+            std::cout << "Найдено записей: " << res.size() << std::endl;
+            printResult(res);
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    void safe_insert_book() {
+        std::string title, isbn, language, year_str, ref_str;
+        int genre_id;
+
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "Безопасное добавление книги" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        std::cout << "Название: ";
+        clearLine();
+        std::getline(std::cin, title);
+        std::cout << "ID жанра: ";
+        std::cin >> genre_id;
+        std::cout << "ISBN (опционально): ";
+        clearLine();
+        std::getline(std::cin, isbn);
+        std::cout << "Год издания (опционально): ";
+        std::getline(std::cin, year_str);
+        std::cout << "Язык (опционально): ";
+        std::getline(std::cin, language);
+        std::cout << "Справочная книга? (да/нет): ";
+        std::getline(std::cin, ref_str);
+
+        try {
+            BoundedOperation op(watchdog, *conn, limitsFor(OpClass::Write));
+            pqxx::work txn(*conn);
+            op.apply(txn);
+            bool is_reference = (ref_str == "да" || ref_str == "Да" || ref_str == "yes" || ref_str == "y");
+
+            std::string sql =
+                "INSERT INTO books (genre_id, title, isbn, published_year, language, is_reference) VALUES (" +
+                txn.quote(genre_id) + ", " +
+                txn.quote(title) + ", " +
+                (isbn.empty() ? "NULL" : txn.quote(isbn)) + ", " +
+                (year_str.empty() ? "NULL" : txn.quote(std::stoi(year_str))) + ", " +
+                (language.empty() ? "NULL" : txn.quote(language)) + ", " +
+                txn.quote(is_reference) + ") "
+                "RETURNING book_id, title";
+
+            pqxx::result res = txn.exec(sql);
+            pqxx::result full = txn.exec_params("SELECT * FROM books WHERE book_id = $1", res[0]["book_id"].as<int>());
+            txn.commit();
+            replicateRow("books", "book_id", full);
+
+            std::cout << "\nКнига успешно добавлена!" << std::endl;
+            std::cout << "ID: " << res[0]["book_id"].c_str() << std::endl;
+            std::cout << "Название: " << res[0]["title"].c_str() << std::endl;
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    void reader_card(int reader_id) {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "Карточка читателя" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        try {
+            ReaderSummaries& cards = readerSummaries();
+            if (!cards.wait_ready(std::chrono::seconds(30))) {
+                std::cout << "Сводки читателей еще загружаются, повторите позже" << std::endl;
+                return;
+            }
+            printTable(reader_cards_table({cards.card(reader_id, local_date_today())}));
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    void reader_summaries_check() {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "Проверка сводок читателей" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        try {
+            ReaderSummaries& cards = readerSummaries();
+            if (!cards.wait_ready(std::chrono::seconds(30))) {
+                std::cout << "Сводки читателей еще загружаются, повторите позже" << std::endl;
+                return;
+            }
+
+            SummaryCheck result = cards.check([this]() {
+                return scatter(LibrarySql::reader_summaries(), OpClass::Report, false);
+            }, std::chrono::milliseconds(limitsFor(OpClass::Report).deadline_ms));
+            std::cout << "Проверено читателей: " << result.checked << ", расхождений: " << result.mismatches.size()
+                      << ", пропущено из-за новых выдач: " << result.busy << std::endl;
+            if (result.mismatches.empty()) return;
+
+            std::vector<ReaderCard> cached, expected;
+            for (const auto& mismatch : result.mismatches) {
+                cached.push_back(mismatch.first);
+                expected.push_back(mismatch.second);
+            }
+            std::cout << "--- В памяти ---" << std::endl;
+            printTable(reader_cards_table(cached));
+            std::cout << "--- В БД ---" << std::endl;
+            printTable(reader_cards_table(expected));
+
+            for (size_t shard : result.shards) {
+                cards.reload(shard);
+                std::cout << "Сводки филиала " << shards[shard].branch << " перечитываются из БД" << std::endl;
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+    }
+
+    void loans_dashboard() {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "Сводка: выдачи, просрочки, жанры" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        bool timed_out = false;
+        try {
+            std::vector<WatchedBackend> backends;
+            for (size_t shard = 0; shard < shards.size(); ++shard) {
+                std::vector<WatchedBackend> shard_backends = asyncFor(shard).backends();
+                backends.insert(backends.end(), shard_backends.begin(), shard_backends.end());
+            }
+            BoundedOperation op(watchdog, backends, limitsFor(OpClass::Report));
+            auto started = std::chrono::steady_clock::now();
+
+            std::vector<std::future<ResultTable>> active, overdue, genres;
+            for (size_t shard = 0; shard < shards.size(); ++shard) {
+                AsyncPg& engine = asyncFor(shard);
+                active.push_back(engine.submit(LibrarySql::active_loans()));
+                overdue.push_back(engine.submit(LibrarySql::overdue_loans()));
+                genres.push_back(engine.submit(LibrarySql::popular_genres()));
+            }
+
+            const OpLimits& limits = limitsFor(OpClass::Report);
+            auto give_up_at = started + std::chrono::milliseconds(limits.deadline_ms + limits.grace_ms);
+            auto collect = [give_up_at, &timed_out](std::future<ResultTable>& result) {
+                if (result.wait_until(give_up_at) != std::future_status::ready) {
+                    timed_out = true;
+                    throw std::runtime_error("Сводка не получена в срок, сервер не отвечает");
+                }
+                return result.get();
+            };
+
+            std::vector<ResultTable> active_parts, overdue_parts, genre_parts;
+            for (size_t shard = 0; shard < shards.size(); ++shard) {
+                active_parts.push_back(collect(active[shard]));
+                addBranchColumn(active_parts.back(), shard);
+                overdue_parts.push_back(collect(overdue[shard]));
+                addBranchColumn(overdue_parts.back(), shard);
+                genre_parts.push_back(collect(genres[shard]));
+            }
+
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - started);
+
+            std::cout << "\n--- Текущие выдачи ---" << std::endl;
+            printTable(merge_sorted(active_parts, ReportOrder::active_loans()));
+            std::cout << "--- Просроченные выдачи ---" << std::endl;
+            printTable(merge_sorted(overdue_parts, ReportOrder::overdue_loans()));
+            std::cout << "--- Популярные жанры ---" << std::endl;
+            printTable(combine_counts(genre_parts, 0, 1));
+            std::cout << "Время получения сводки: " << elapsed.count() << " мс" << std::endl;
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+        }
+
+        if (timed_out) {
+            for (auto& shard : shards) {
+                shard.async.reset();
+            }
+        }
+    }
+
+    void init_database() {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "Инициализация базы данных" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        for (size_t shard = 0; shard < shards.size(); ++shard) {
+            try {
+                pqxx::connection& shard_conn = *shards[shard].conn;
+                BoundedOperation op(watchdog, shard_conn, limitsFor(OpClass::Write));
+                pqxx::work txn(shard_conn);
+                op.apply(txn);
+
+                std::vector<std::string> tables = LibrarySql::schema();
+
+                for (const auto& sql : tables) {
+                    txn.exec(sql);
+                }
+
+                std::string first_id = std::to_string(shard * shard_id_span + 1);
+                std::string last_id = std::to_string((shard + 1) * shard_id_span - 1);
+                for (const std::string seq : {"copies_copy_id_seq", "loans_loan_id_seq", "holds_hold_id_seq"}) {
+                    txn.exec("SELECT setval('" + seq + "', " + first_id + ", false) FROM " + seq +
+                             " WHERE last_value < " + first_id);
+                    txn.exec("ALTER SEQUENCE " + seq + " MINVALUE " + first_id + " MAXVALUE " + last_id +
+                             " START " + first_id);
+                }
+
+                txn.commit();
+                if (shards.size() > 1) {
+                    std::cout << "Филиал " << shards[shard].branch << ": ";
+                }
+                std::cout << "Таблицы созданы успешно!" << std::endl;
+            } catch (const std::exception &e) {
+                std::cerr << "Ошибка: " << e.what() << std::endl;
+            }
+        }
+        if (summaries) {
+            summaries->reload();
+        }
+    }
+
+    void seed_data() {
+        std::cout << "\n═══════════════════════════════════════════" << std::endl;
+        std::cout << "Заполнение тестовыми данными" << std::endl;
+        std::cout << "═══════════════════════════════════════════" << std::endl;
+
+        std::vector<std::string> reference = {
+            R"(
+                INSERT INTO genres (genre_id, genre) VALUES
+                (1, 'Фантастика'),
+                (2, 'История'),
+                (3, 'Классика'),
+                (4, 'Научпоп')
+            )",
+
+            R"(
+                INSERT INTO authors (author_id, full_name, country) VALUES
+                (1, 'Айзек Азимов', 'США'),
+                (2, 'Лев Толстой', 'Россия'),
+                (3, 'Юваль Харари', 'Израиль'),
+                (4, 'Братья Стругацкие', 'Россия')
+            )",
+
+            R"(
+                INSERT INTO readers (reader_id, full_name, "group", email, status, registration_date) VALUES
+                (1, 'Иван Петров', 'БИБ-101', 'ivan@example.com', 'active', CURRENT_DATE - 30),
+                (2, 'Мария Соколова', 'БИБ-102', 'maria@example.com', 'active', CURRENT_DATE - 10),
+                (3, 'Алексей Ким', NULL, 'alex@example.com', 'inactive', CURRENT_DATE - 100)
+            )",
+
+            R"(
+                INSERT INTO books (book_id, genre_id, title, isbn, published_year, language, is_reference) VALUES
+                (1, 1, 'Основание', '978-1-234', 1951, 'ru', false),
+                (2, 3, 'Война и мир', '978-1-235', 1869, 'ru', false),
+                (3, 4, 'Sapiens', '978-1-236', 2011, 'en', false),
+                (4, 1, 'Понедельник начинается в субботу', '978-1-237', 1965, 'ru', false)
+            )",
+
+            R"(
+                INSERT INTO book_authors (book_id, author_id) VALUES
+                (1, 1),
+                (2, 2),
+                (3, 3),
+                (4, 4)
+            )"
+        };
+
+        std::vector<std::string> copies = {
+            "1, 'INV-001', 'Абонемент', 'in_stock'",
+            "1, 'INV-002', 'Зал 1', 'loaned'",
+            "2, 'INV-003', 'Абонемент', 'loaned'",
+            "3, 'INV-004', 'Зал 2', 'in_stock'",
+            "4, 'INV-005', 'Зал 1', 'in_stock'"
+        };
+
+        std::vector<std::pair<size_t, std::string>> loans = {
+            {2, "1, CURRENT_DATE - 15, CURRENT_DATE - 5, NULL, 0"},
+            {3, "2, CURRENT_DATE - 7, CURRENT_DATE + 7, NULL, 0"}
+        };
+
+        for (size_t shard = 0; shard < shards.size(); ++shard) {
+            try {
+                pqxx::connection& shard_conn = *shards[shard].conn;
+                long long base = static_cast<long long>(shard) * shard_id_span;
+
+                BoundedOperation cleanup_op(watchdog, shard_conn, limitsFor(OpClass::Write));
+                pqxx::work cleanup(shard_conn);
+                cleanup_op.apply(cleanup);
+                cleanup.exec("TRUNCATE loans, copies, book_authors, books, authors, readers, genres CASCADE");
+                cleanup.commit();
+
+                BoundedOperation op(watchdog, shard_conn, limitsFor(OpClass::Write));
+                pqxx::work txn(shard_conn);
+                op.apply(txn);
+
+                for (const auto& sql : reference) {
+                    txn.exec(sql);
+                }
+
+                for (size_t n = 1; n <= copies.size(); ++n) {
+                    if ((n - 1) % shards.size() != shard) continue;
+                    txn.exec("INSERT INTO copies (copy_id, book_id, inventory_number, location, status) VALUES (" +
+                             std::to_string(base + static_cast<long long>(n)) + ", " + copies[n - 1] + ")");
+                }
+
+                for (size_t n = 1; n <= loans.size(); ++n) {
+                    size_t copy = loans[n - 1].first;
+                    if ((copy - 1) % shards.size() != shard) continue;
+                    txn.exec("INSERT INTO loans (loan_id, copy_id, reader_id, loan_date, due_date, return_date, fine_amount) VALUES (" +
+                             std::to_string(base + static_cast<long long>(n)) + ", " +
+                             std::to_string(base + static_cast<long long>(copy)) + ", " + loans[n - 1].second + ")");
+                }
+
+                txn.commit();
+
+                std::string floor = std::to_string(base);
+                BoundedOperation reset_seq_op(watchdog, shard_conn, limitsFor(OpClass::Write));
+                pqxx::work reset_seq(shard_conn);
+                reset_seq_op.apply(reset_seq);
+                reset_seq.exec("SELECT setval('genres_genre_id_seq', COALESCE((SELECT MAX(genre_id) FROM genres), 0) + 1, false)");
+                reset_seq.exec("SELECT setval('authors_author_id_seq', COALESCE((SELECT MAX(author_id) FROM authors), 0) + 1, false)");
+                reset_seq.exec("SELECT setval('readers_reader_id_seq', COALESCE((SELECT MAX(reader_id) FROM readers), 0) + 1, false)");
+                reset_seq.exec("SELECT setval('books_book_id_seq', COALESCE((SELECT MAX(book_id) FROM books), 0) + 1, false)");
+                reset_seq.exec("SELECT setval('copies_copy_id_seq', COALESCE((SELECT MAX(copy_id) FROM copies), " + floor + ") + 1, false)");
+                reset_seq.exec("SELECT setval('loans_loan_id_seq', COALESCE((SELECT MAX(loan_id) FROM loans), " + floor + ") + 1, false)");
+                reset_seq.exec("SELECT setval('holds_hold_id_seq', COALESCE((SELECT MAX(hold_id) FROM holds), " + floor + ") + 1, false)");
+                reset_seq.commit();
+
+                if (shards.size() > 1) {
+                    std::cout << "Филиал " << shards[shard].branch << ": ";
+                }
+                std::cout << "Все тестовые данные успешно добавлены!" << std::endl;
+            } catch (const std::exception &e) {
+                std::cerr << "Ошибка: " << e.what() << std::endl;
+            }
+        }
+        if (summaries) {
+            summaries->reload();
+        }
+    }
+};
+
+static std::string build_conn_string(const std::string& dbname = "") {
+    std::string host = get_env_or_default("DB_HOST", "localhost");
+    std::string port = get_env_or_default("DB_PORT", "5432");
+    std::string name = dbname.empty() ? get_env_or_default("DB_NAME", "library") : dbname;
+    std::string user = get_env_or_default("DB_USER", "postgres");
+    std::string pass = get_env_or_default("DB_PASSWORD", "postgres");
+
+    return "host=" + host + " port=" + port + " dbname=" + name + " user=" + user + " password=" + pass;
+}
+
+static std::vector<ShardConfig> build_shard_configs() {
+    std::vector<ShardConfig> configs;
+    std::stringstream list(get_env_or_default("DB_SHARDS", ""));
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos || eq == 0 || eq + 1 == item.size()) {
+            std::cerr << "Некорректный элемент DB_SHARDS (ожидается филиал=база): " << item << std::endl;
+            exit(1);
+        }
+        configs.push_back(ShardConfig{item.substr(0, eq), build_conn_string(item.substr(eq + 1))});
+    }
+
+    if (configs.empty()) {
+        configs.push_back(ShardConfig{"main", build_conn_string()});
+    }
+    return configs;
+}
+
+struct ReminderTimer {
+    int loan_id;
+    int reader_id;
+    int kind;
+};
+
+class TimerWheel {
+private:
+    static constexpr int level_bits = 6;
+    static constexpr int levels = 4;
+    static constexpr uint64_t slot_count = 1ull << level_bits;
+    static constexpr uint64_t slot_mask = slot_count - 1;
+
+    struct Node {
+        uint64_t expires;
+        int64_t key;
+        ReminderTimer timer;
+        int32_t prev;
+        int32_t next;
+        int32_t slot;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int32_t> heads;
+    std::unordered_map<int64_t, int32_t> index;
+    int32_t free_head;
+    uint64_t now;
+
+    void link(int32_t id, uint64_t min_tick) {
+        Node& node = nodes[id];
+        uint64_t effective = std::max(node.expires, min_tick);
+        uint64_t delta = effective - now;
+
+        int level = 0;
+        while (level < levels && delta >= (1ull << (level_bits * (level + 1)))) {
+            ++level;
+        }
+        if (level == levels) {
+            level = levels - 1;
+            effective = now + (1ull << (level_bits * levels)) - 1;
+        }
+
+        int32_t slot = level * static_cast<int32_t>(slot_count) +
+                       static_cast<int32_t>((effective >> (level_bits * level)) & slot_mask);
+        node.slot = slot;
+        node.prev = -1;
+        node.next = heads[slot];
+        if (node.next != -1) {
+            nodes[node.next].prev = id;
+        }
+        heads[slot] = id;
+    }
+
+    void unlink(int32_t id) {
+        Node& node = nodes[id];
+        if (node.prev != -1) {
+            nodes[node.prev].next = node.next;
+        } else {
+            heads[node.slot] = node.next;
+        }
+        if (node.next != -1) {
+            nodes[node.next].prev = node.prev;
+        }
+        node.slot = -1;
+    }
+
+    void release(int32_t id) {
+        index.erase(nodes[id].key);
+        nodes[id].next = free_head;
+        free_head = id;
+    }
+
+    void cascade(int level, uint64_t slot_index) {
+        int32_t slot = level * static_cast<int32_t>(slot_count) + static_cast<int32_t>(slot_index);
+        int32_t id = heads[slot];
+        heads[slot] = -1;
+        while (id != -1) {
+            int32_t next = nodes[id].next;
+            link(id, now);
+            id = next;
+        }
+    }
+
+    void tick(std::vector<ReminderTimer>& fired) {
+        ++now;
+        for (int level = 1; level < levels; ++level) {
+            if ((now & ((1ull << (level_bits * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(level, (now >> (level_bits * level)) & slot_mask);
+        }
+
+        int32_t slot = static_cast<int32_t>(now & slot_mask);
+        int32_t id = heads[slot];
+        heads[slot] = -1;
+        while (id != -1) {
+            int32_t next = nodes[id].next;
+            fired.push_back(nodes[id].timer);
+            nodes[id].slot = -1;
+            release(id);
+            id = next;
+        }
+    }
+
+public:
+    explicit TimerWheel(uint64_t start_tick)
+        : heads(levels * slot_count, -1), free_head(-1), now(start_tick) {}
+
+    void reserve(size_t count) {
+        nodes.reserve(count);
+        index.reserve(count);
+    }
+
+    void schedule(int64_t key, uint64_t expires, const ReminderTimer& timer) {
+        int32_t id;
+        auto it = index.find(key);
+        if (it != index.end()) {
+            id = it->second;
+            unlink(id);
+        } else if (free_head != -1) {
+            id = free_head;
+            free_head = nodes[id].next;
+            index[key] = id;
+        } else {
+            id = static_cast<int32_t>(nodes.size());
+            nodes.push_back(Node());
+            index[key] = id;
+        }
+
+        nodes[id].expires = expires;
+        nodes[id].key = key;
+        nodes[id].timer = timer;
+        link(id, now + 1);
+    }
+
+    bool cancel(int64_t key) {
+        auto it = index.find(key);
+        if (it == index.end()) {
+            return false;
+        }
+        int32_t id = it->second;
+        unlink(id);
+        release(id);
+        return true;
+    }
+
+    void advance_to(uint64_t target, std::vector<ReminderTimer>& fired) {
+        while (now < target) {
+            tick(fired);
+        }
+    }
+
+    size_t size() const {
+        return index.size();
+    }
+};
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void stop_signal_handler(int) {
+    stop_requested = 1;
+}
+
+class LoanEventReceiver : public pqxx::notification_receiver {
+private:
+    std::vector<int>& pending;
+
+public:
+    LoanEventReceiver(pqxx::connection& conn, std::vector<int>& pending_ids)
+        : pqxx::notification_receiver(conn, "loan_events"), pending(pending_ids) {}
+
+    void operator()(const std::string& payload, int) override {
+        try {
+            pending.push_back(static_cast<int>(JsonValue::parse(payload).get_number("loan_id")));
+        } catch (const std::exception &e) {
+            std::cerr << "Некорректное событие выдачи: " << payload << std::endl;
+        }
+    }
+};
+
+class ReminderDaemon {
+private:
+    static constexpr int kind_due_soon = 0;
+    static constexpr int kind_overdue = 1;
+    static constexpr int reminder_hour = 9;
+    static constexpr int load_batch = 10000;
+
+    std::string conn_str;
+    pqxx::connection* conn;
+    TimerWheel wheel;
+    std::string spool_dir;
+    int days_before;
+    size_t batch_limit;
+    int flush_seconds;
+    std::vector<ReminderTimer> batch;
+    std::chrono::steady_clock::time_point last_flush;
+    unsigned long spool_seq;
+    int pickup_days;
+    int sweep_seconds;
+    std::chrono::steady_clock::time_point last_sweep;
+
+    static uint64_t current_tick() {
+        return static_cast<uint64_t>(std::time(nullptr)) / 60;
+    }
+
+    static uint64_t tick_of_day(long day) {
+        std::tm tm = {};
+        tm.tm_year = 70;
+        tm.tm_mday = 1 + static_cast<int>(day);
+        tm.tm_hour = reminder_hour;
+        tm.tm_isdst = -1;
+        return static_cast<uint64_t>(std::mktime(&tm)) / 60;
+    }
+
+    static int64_t timer_key(int loan_id, int kind) {
+        return static_cast<int64_t>(loan_id) * 2 + kind;
+    }
+
+    static const char* kind_name(int kind) {
+        return kind == kind_due_soon ? "due_soon" : "overdue";
+    }
+
+    static std::string int_array(const std::vector<int>& ids) {
+        std::string literal = "{";
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (i > 0) literal += ",";
+            literal += std::to_string(ids[i]);
+        }
+        return literal + "}";
+    }
+
+    void schedule_loan(int loan_id, int reader_id, long due_day, bool sent_soon, bool sent_overdue) {
+        uint64_t overdue_at = tick_of_day(due_day + 1);
+        if (!sent_overdue) {
+            wheel.schedule(timer_key(loan_id, kind_overdue), overdue_at,
+                           ReminderTimer{loan_id, reader_id, kind_overdue});
+        }
+        if (!sent_soon && current_tick() < overdue_at) {
+            wheel.schedule(timer_key(loan_id, kind_due_soon), tick_of_day(due_day - days_before),
+                           ReminderTimer{loan_id, reader_id, kind_due_soon});
+        } else {
+            wheel.cancel(timer_key(loan_id, kind_due_soon));
+        }
+    }
+
+    static std::string open_loans_sql(const std::string& filter) {
+        return "SELECT l.loan_id, l.reader_id, (l.due_date - DATE '1970-01-01') AS due_day, "
+               "EXISTS (SELECT 1 FROM reminder_log s WHERE s.loan_id = l.loan_id AND s.kind = 'due_soon') AS sent_soon, "
+               "EXISTS (SELECT 1 FROM reminder_log s WHERE s.loan_id = l.loan_id AND s.kind = 'overdue') AS sent_overdue "
+               "FROM loans l "
+               "JOIN readers r ON l.reader_id = r.reader_id "
+               "WHERE l.return_date IS NULL AND r.email IS NOT NULL" + filter;
+    }
+
+    void load_open_loans() {
+        pqxx::work txn(*conn);
+        size_t open_count = txn.exec("SELECT COUNT(*) FROM loans WHERE return_date IS NULL")[0][0].as<size_t>();
+        wheel.reserve(open_count * 2);
+        txn.exec("DECLARE open_loans NO SCROLL CURSOR FOR " + open_loans_sql(""));
+
+        size_t loaded = 0;
+        while (true) {
+            pqxx::result res = txn.exec("FETCH " + std::to_string(load_batch) + " FROM open_loans");
+            if (res.empty()) break;
+            for (const auto& row : res) {
+                schedule_loan(row["loan_id"].as<int>(), row["reader_id"].as<int>(),
+                              row["due_day"].as<long>(), row["sent_soon"].as<bool>(),
+                              row["sent_overdue"].as<bool>());
+            }
+            loaded += res.size();
+        }
+        txn.exec("CLOSE open_loans");
+        txn.commit();
+
+        std::cout << "Загружено открытых выдач: " << loaded
+                  << ", запланировано напоминаний: " << wheel.size() << std::endl;
+    }
+
+    void refresh_loans(std::vector<int>& loan_ids) {
+        std::sort(loan_ids.begin(), loan_ids.end());
+        loan_ids.erase(std::unique(loan_ids.begin(), loan_ids.end()), loan_ids.end());
+
+        pqxx::work txn(*conn);
+        pqxx::result res = txn.exec_params(
+            open_loans_sql(" AND l.loan_id = ANY($1::int[])"), int_array(loan_ids));
+        txn.commit();
+
+        std::unordered_set<int> still_open;
+        for (const auto& row : res) {
+            int loan_id = row["loan_id"].as<int>();
+            still_open.insert(loan_id);
+            schedule_loan(loan_id, row["reader_id"].as<int>(), row["due_day"].as<long>(),
+                          row["sent_soon"].as<bool>(), row["sent_overdue"].as<bool>());
+        }
+        for (int loan_id : loan_ids) {
+            if (still_open.count(loan_id) == 0) {
+                wheel.cancel(timer_key(loan_id, kind_due_soon));
+                wheel.cancel(timer_key(loan_id, kind_overdue));
+            }
+        }
+    }
+
+    void write_spool_file(const std::string& email, const std::string& full_name,
+                          const std::vector<std::string>& lines, int reader_id) {
+        std::string name = std::to_string(std::time(nullptr)) + "-" + std::to_string(getpid()) + "-" +
+                           std::to_string(++spool_seq) + "-" + std::to_string(reader_id) + ".eml";
+        std::filesystem::path tmp_path = std::filesystem::path(spool_dir) / ("." + name + ".tmp");
+        std::filesystem::path final_path = std::filesystem::path(spool_dir) / name;
+
+        std::ofstream out(tmp_path);
+        out << "To: " << email << "\n";
+        out << "Subject: Напоминание о сроке возврата книг\n\n";
+        out << "Здравствуйте, " << full_name << "!\n\n";
+        for (const auto& line : lines) {
+            out << line << "\n";
+        }
+        out << "\nБиблиотека\n";
+        out.close();
+        if (!out) {
+            std::error_code ignored;
+            std::filesystem::remove(tmp_path, ignored);
+            throw std::runtime_error("Не удалось записать файл спула: " + tmp_path.string());
+        }
+        std::filesystem::rename(tmp_path, final_path);
+    }
+
+    void flush() {
+        if (batch.empty()) return;
+
+        std::stable_sort(batch.begin(), batch.end(), [](const ReminderTimer& a, const ReminderTimer& b) {
+            return a.reader_id < b.reader_id;
+        });
+        size_t done = 0;
+        while (done < batch.size()) {
+            size_t end = std::min(batch.size(), done + batch_limit);
+            while (end < batch.size() && batch[end].reader_id == batch[end - 1].reader_id) {
+                ++end;
+            }
+            flush_chunk(done, end);
+            done = end;
+        }
+        batch.clear();
+        last_flush = std::chrono::steady_clock::now();
+    }
+
+    void flush_chunk(size_t begin, size_t end) {
+        std::vector<int> loan_ids;
+        for (size_t i = begin; i < end; ++i) {
+            loan_ids.push_back(batch[i].loan_id);
+        }
+
+        pqxx::work txn(*conn);
+        pqxx::result res = txn.exec_params(
+            "SELECT l.loan_id, r.full_name, r.email, b.title, l.due_date "
+            "FROM loans l "
+            "JOIN readers r ON l.reader_id = r.reader_id "
+            "JOIN copies c ON l.copy_id = c.copy_id "
+            "JOIN books b ON c.book_id = b.book_id "
+            "WHERE l.loan_id = ANY($1::int[]) AND l.return_date IS NULL AND r.email IS NOT NULL",
+            int_array(loan_ids)
+        );
+
+        std::unordered_map<int, size_t> rows_by_loan;
+        for (size_t i = 0; i < res.size(); ++i) {
+            rows_by_loan[res[i]["loan_id"].as<int>()] = i;
+        }
+
+        std::map<int, std::vector<const ReminderTimer*>> by_reader;
+        for (size_t i = begin; i < end; ++i) {
+            if (rows_by_loan.count(batch[i].loan_id) != 0) {
+                by_reader[batch[i].reader_id].push_back(&batch[i]);
+            }
+        }
+
+        std::vector<int> sent_loans;
+        std::vector<std::string> sent_kinds;
+        for (const auto& entry : by_reader) {
+            const auto& first = res[rows_by_loan[entry.second.front()->loan_id]];
+            std::vector<std::string> lines;
+            for (const ReminderTimer* timer : entry.second) {
+                const auto& row = res[rows_by_loan[timer->loan_id]];
+                std::string prefix = timer->kind == kind_due_soon ? "Скоро срок возврата: " : "Просрочен возврат: ";
+                lines.push_back(prefix + "\"" + row["title"].c_str() + "\" до " + row["due_date"].c_str());
+                sent_loans.push_back(timer->loan_id);
+                sent_kinds.push_back(kind_name(timer->kind));
+            }
+            write_spool_file(first["email"].c_str(), first["full_name"].c_str(), lines, entry.first);
+        }
+
+        if (!sent_loans.empty()) {
+            std::string kinds = "{";
+            for (size_t i = 0; i < sent_kinds.size(); ++i) {
+                if (i > 0) kinds += ",";
+                kinds += sent_kinds[i];
+            }
+            kinds += "}";
+            txn.exec_params(
+                "INSERT INTO reminder_log (loan_id, kind) "
+                "SELECT * FROM unnest($1::int[], $2::varchar[]) "
+                "ON CONFLICT DO NOTHING",
+                int_array(sent_loans),
+                kinds
+            );
+        }
+        txn.commit();
+
+        std::cout << "Отправлено в спул: " << by_reader.size() << " писем, "
+                  << sent_loans.size() << " напоминаний" << std::endl;
+    }
+
+    void sweep_holds() {
+        last_sweep = std::chrono::steady_clock::now();
+        HoldSweep sweep;
+        try {
+            pqxx::work txn(*conn);
+            sweep = LoanOps::expire_holds(txn, pickup_days);
+            txn.commit();
+        } catch (const pqxx::broken_connection &) {
+            throw;
+        } catch (const std::exception &e) {
+            std::cerr << "Снятие истекших броней не выполнено: " << e.what() << std::endl;
+            return;
+        }
+
+        if (sweep.waiting.empty() && sweep.ready.empty()) return;
+        size_t reassigned = 0;
+        for (const auto& assigned : sweep.reassigned) {
+            reassigned += assigned.size();
+        }
+        std::cout << "Истекло броней: ожидающих " << sweep.waiting.size() << ", неполученных "
+                  << sweep.ready.size() << ", передано следующим в очереди: " << reassigned << std::endl;
+    }
+
+    void ensure_schema() {
+        pqxx::work txn(*conn);
+        txn.exec("SET LOCAL client_min_messages = warning");
+        for (const auto& sql : LibrarySql::schema()) {
+            txn.exec(sql);
+        }
+        txn.commit();
+    }
+
+    void serve() {
+        ensure_schema();
+        std::vector<int> pending;
+        LoanEventReceiver receiver(*conn, pending);
+        load_open_loans();
+        std::cout << "Сервис напоминаний запущен, спул: " << spool_dir << std::endl;
+
+        while (!stop_requested) {
+            conn->await_notification(1, 0);
+
+            if (!pending.empty()) {
+                std::vector<int> loan_ids;
+                loan_ids.swap(pending);
+                refresh_loans(loan_ids);
+            }
+
+            wheel.advance_to(current_tick(), batch);
+
+            auto since_flush = std::chrono::steady_clock::now() - last_flush;
+            if (batch.size() >= batch_limit ||
+                (!batch.empty() && since_flush >= std::chrono::seconds(flush_seconds))) {
+                flush();
+            }
+
+            if (std::chrono::steady_clock::now() - last_sweep >= std::chrono::seconds(sweep_seconds)) {
+                sweep_holds();
+            }
+        }
+
+        flush();
+    }
+
+public:
+    ReminderDaemon(const std::string& conn_string, const std::string& spool, int days,
+                   size_t max_batch, int flush_interval, int hold_pickup_days, int hold_sweep_seconds)
+        : conn_str(conn_string), conn(connect_with_retry(conn_string)), wheel(current_tick()), spool_dir(spool),
+          days_before(days), batch_limit(std::max<size_t>(max_batch, 1)), flush_seconds(flush_interval),
+          last_flush(std::chrono::steady_clock::now()), spool_seq(0), pickup_days(hold_pickup_days),
+          sweep_seconds(hold_sweep_seconds), last_sweep() {}
+
+    ~ReminderDaemon() {
+        delete conn;
+    }
+
+    bool run() {
+        std::signal(SIGINT, stop_signal_handler);
+        std::signal(SIGTERM, stop_signal_handler);
+
+        try {
+            std::filesystem::create_directories(spool_dir);
+        } catch (const std::exception &e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+            return false;
+        }
+
+        while (true) {
+            try {
+                serve();
+                std::cout << "Сервис напоминаний остановлен" << std::endl;
+                return true;
+            } catch (const pqxx::broken_connection &e) {
+                std::cerr << "Соединение с БД потеряно: " << e.what() << std::endl;
+            } catch (const std::exception &e) {
+                std::cerr << "Ошибка: " << e.what() << std::endl;
+                return false;
+            }
+            if (stop_requested) return false;
+
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            delete conn;
+            conn = connect_with_retry(conn_str);
+            wheel = TimerWheel(current_tick());
+            batch.clear();
+        }
+    }
+};
+
+static int run_reminders(const std::vector<ShardConfig>& shard_configs) {
+    std::string spool = get_env_or_default("REMINDER_SPOOL", "spool");
+    int days_before = std::stoi(get_env_or_default("REMINDER_DAYS_BEFORE", "2"));
+    size_t batch = static_cast<size_t>(std::stoi(get_env_or_default("REMINDER_BATCH", "500")));
+    int flush_seconds = std::stoi(get_env_or_default("REMINDER_FLUSH_SECONDS", "60"));
+    int pickup_days = std::stoi(get_env_or_default("HOLD_PICKUP_DAYS", "3"));
+    int sweep_seconds = std::stoi(get_env_or_default("HOLD_SWEEP_SECONDS", "60"));
+
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> workers;
+    for (const auto& config : shard_configs) {
+        std::string shard_spool = shard_configs.size() > 1
+            ? (std::filesystem::path(spool) / config.branch).string()
+            : spool;
+        workers.emplace_back([config, shard_spool, days_before, batch, flush_seconds, pickup_days, sweep_seconds,
+                              &failed]() {
+            ReminderDaemon daemon(config.conn_str, shard_spool, days_before, batch, flush_seconds,
+                                  pickup_days, sweep_seconds);
+            if (!daemon.run()) {
+                failed = true;
+                stop_requested = 1;
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return failed ? 1 : 0;
+}
+
+struct PlanNode {
+    int depth;
+    std::string node_type;
+    std::string relation;
+    std::string index;
+    double plan_rows;
+    double buffers;
+};
+
+static bool is_local_host(const std::string& host) {
+    return host == "localhost" || host == "127.0.0.1" || host == "::1" ||
+           (!host.empty() && host[0] == '/');
+}
+
+class PlanRegression {
+private:
+    struct PlanQuery {
+        std::string name;
+        std::string sql;
+        std::string args;
+    };
+
     pqxx::connection* conn;
+    std::vector<int> scales;
+    double tolerance;
+    std::string baseline_path;
+    int statement_counter;
+
+    static std::vector<PlanQuery> plan_queries(pqxx::transaction_base& txn) {
+        return {
+            {"q1_books_by_genre", LibrarySql::books_by_genre("Жанр 1"), ""},
+            {"q2_books_with_multiple_authors", LibrarySql::books_with_multiple_authors(), ""},
+            {"q3_authors_book_count", LibrarySql::authors_book_count(), ""},
+            {"q4_available_copies_by_title", LibrarySql::available_copies_by_title("Книга 1"), ""},
+            {"q5_active_loans", LibrarySql::active_loans(), ""},
+            {"q6_overdue_loans", LibrarySql::overdue_loans(), ""},
+            {"q7_popular_genres", LibrarySql::popular_genres(), ""},
+            {"q8_close_loan", LibrarySql::close_loan(), "(5)"},
+            {"q8_assign_next_hold", LibrarySql::assign_next_hold(), "(1, 3)"},
+            {"q8_release_copy", LibrarySql::release_copy(), "(1)"},
+            {"q8_reserve_copy", LibrarySql::reserve_copy(), "(1)"},
+            {"q8_loan_info", LibrarySql::loan_info(), "(5)"},
+            {"q9_insert_reader", LibrarySql::insert_reader(txn, "Проверка планов", "ГР-0",
+                                                           "plan-check@example.com", "active"), ""},
+            {"q10_lock_copy", LibrarySql::lock_copy(), "(1)"},
+            {"q10_insert_loan", LibrarySql::insert_loan(), "(1, 1, CURRENT_DATE + 14)"},
+            {"q10_mark_copy_loaned", LibrarySql::mark_copy_loaned(), "(1)"},
+            {"q10_ready_hold_for_copy", LibrarySql::ready_hold_for_copy(), "(10)"},
+            {"q10_fulfill_hold", LibrarySql::fulfill_hold(), "(10)"},
+            {"q10_next_waiting_hold", LibrarySql::next_waiting_hold(), "(1)"},
+            {"q11_in_stock_copy", LibrarySql::in_stock_copy(), "(1)"},
+            {"q11_place_hold", LibrarySql::place_hold(), "(1, 2, 30)"},
+            {"q12_waiting_holds", LibrarySql::waiting_holds(), "(1)"},
+            {"q13_expire_waiting_holds", LibrarySql::expire_waiting_holds(), ""},
+            {"q13_expire_ready_holds", LibrarySql::expire_ready_holds(), ""},
+            {"serve_search_books", LibrarySql::search_books(), "('%Книга 1%')"},
+            {"cards_reader_summaries", LibrarySql::reader_summaries(), ""},
+            {"cards_open_loans_by_reader", LibrarySql::open_loans_by_reader(), ""},
+            {"cards_reader_loan_totals", LibrarySql::reader_loan_totals(), ""}
+        };
+    }
+
+    void generate_dataset(int scale) {
+        std::string authors = std::to_string(200 * scale);
+        std::string readers = std::to_string(1000 * scale);
+        std::string books = std::to_string(500 * scale);
+        std::string copies = std::to_string(1000 * scale);
+        std::string loans = std::to_string(5000 * scale);
+        std::string holds = std::to_string(800 * scale);
+
+        pqxx::nontransaction setup(*conn);
+        setup.exec("DROP SCHEMA IF EXISTS plan_check CASCADE");
+        setup.exec("CREATE SCHEMA plan_check");
+        setup.exec("SET search_path TO plan_check");
+
+        pqxx::work txn(*conn);
+        for (const auto& sql : LibrarySql::schema()) {
+            txn.exec(sql);
+        }
+        txn.exec("INSERT INTO genres (genre) SELECT 'Жанр ' || g FROM generate_series(1, 20) g");
+        txn.exec("INSERT INTO authors (full_name, country) "
+                 "SELECT 'Автор ' || a, 'Страна ' || (a % 15) FROM generate_series(1, " + authors + ") a");
+        txn.exec("INSERT INTO readers (full_name, \"group\", email, status) "
+                 "SELECT 'Читатель ' || r, 'ГР-' || (r % 50), 'reader' || r || '@example.com', "
+                 "CASE WHEN r % 10 = 0 THEN 'inactive' ELSE 'active' END "
+                 "FROM generate_series(1, " + readers + ") r");
+        txn.exec("INSERT INTO books (genre_id, title, isbn, published_year, language, is_reference) "
+                 "SELECT 1 + b % 20, 'Книга ' || b, 'ISBN-' || b, 1900 + b % 120, "
+                 "CASE WHEN b % 3 = 0 THEN 'en' ELSE 'ru' END, b % 25 = 0 "
+                 "FROM generate_series(1, " + books + ") b");
+        txn.exec("INSERT INTO book_authors (book_id, author_id) "
+                 "SELECT b, 1 + b % " + authors + " FROM generate_series(1, " + books + ") b "
+                 "UNION "
+                 "SELECT b, 1 + (b * 7 + 3) % " + authors + " FROM generate_series(1, " + books + ") b "
+                 "WHERE b % 3 = 0");
+        txn.exec("INSERT INTO copies (book_id, inventory_number, location, status) "
+                 "SELECT 1 + (c - 1) / 2, 'INV-' || c, 'Зал ' || (1 + c % 3), "
+                 "CASE WHEN c % 4 = 0 THEN 'loaned' ELSE 'in_stock' END "
+                 "FROM generate_series(1, " + copies + ") c");
+        txn.exec("INSERT INTO loans (reader_id, copy_id, loan_date, due_date, return_date, fine_amount) "
+                 "SELECT 1 + (l * 31) % " + readers + ", 1 + (l * 17) % " + copies + ", "
+                 "CURRENT_DATE - l % 60, CURRENT_DATE - l % 60 + 14, "
+                 "CASE WHEN l % 5 = 0 THEN NULL ELSE LEAST(CURRENT_DATE, CURRENT_DATE - l % 60 + l % 20) END, 0 "
+                 "FROM generate_series(1, " + loans + ") l");
+        txn.exec("INSERT INTO holds (book_id, reader_id, created_at, expires_at, status, copy_id) "
+                 "SELECT 1 + h % " + books + ", h, NOW() - h * INTERVAL '1 minute', "
+                 "NOW() + CASE WHEN h % 20 = 1 THEN INTERVAL '-1 day' ELSE INTERVAL '30 days' END, "
+                 "CASE WHEN h % 10 = 0 THEN 'ready' WHEN h % 7 = 0 THEN 'fulfilled' ELSE 'waiting' END, "
+                 "CASE WHEN h % 10 = 0 THEN h END "
+                 "FROM generate_series(1, " + holds + ") h");
+        txn.exec("ANALYZE genres, authors, readers, books, book_authors, copies, loans, reminder_log, holds");
+        txn.commit();
+    }
+
+    static void collect(const JsonValue& plan, int depth, std::vector<PlanNode>& out) {
+        out.push_back(PlanNode{
+            depth,
+            plan.get_string("Node Type"),
+            plan.get_string("Relation Name", "-"),
+            plan.get_string("Index Name", "-"),
+            plan.get_number("Plan Rows"),
+            plan.get_number("Shared Hit Blocks") + plan.get_number("Shared Read Blocks")
+        });
+
+        const JsonValue* children = plan.find("Plans");
+        if (children) {
+            for (const auto& child : children->items) {
+                collect(child, depth + 1, out);
+            }
+        }
+    }
+
+    std::vector<PlanNode> explain(const PlanQuery& query) {
+        std::string target = query.sql;
+        std::string statement;
+        if (!query.args.empty()) {
+            statement = "plan_stmt_" + std::to_string(++statement_counter);
+            pqxx::nontransaction prepare(*conn);
+            prepare.exec("PREPARE " + statement + " AS " + query.sql);
+            target = "EXECUTE " + statement + query.args;
+        }
+
+        std::vector<PlanNode> nodes;
+        try {
+            pqxx::work txn(*conn);
+            pqxx::result res = txn.exec("EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) " + target);
+            txn.abort();
+
+            JsonValue doc = JsonValue::parse(res[0][0].c_str());
+            if (doc.items.empty() || !doc.items[0].find("Plan")) {
+                throw std::runtime_error("Некорректный EXPLAIN для " + query.name);
+            }
+            collect(*doc.items[0].find("Plan"), 0, nodes);
+        } catch (...) {
+            try {
+                deallocate(statement);
+            } catch (const std::exception &e) {
+                std::cerr << "Ошибка: " << e.what() << std::endl;
+            }
+            throw;
+        }
 
-    void printResult(const pqxx::result& res) {
-        if (res.empty()) {
-            std::cout << "Нет данных" << std::endl;
-            return;
+        deallocate(statement);
+        return nodes;
+    }
+
+    void deallocate(const std::string& statement) {
+        if (statement.empty()) return;
+        pqxx::nontransaction cleanup(*conn);
+        cleanup.exec("DEALLOCATE " + statement);
+    }
+
+    std::map<std::string, std::vector<PlanNode>> capture() {
+        std::map<std::string, std::vector<PlanNode>> plans;
+        for (int scale : scales) {
+            std::cout << "Генерация данных, масштаб " << scale << "..." << std::endl;
+            generate_dataset(scale);
+
+            std::vector<PlanQuery> queries;
+            {
+                pqxx::nontransaction txn(*conn);
+                queries = plan_queries(txn);
+            }
+            for (const auto& query : queries) {
+                plans[query.name + "@" + std::to_string(scale)] = explain(query);
+            }
         }
 
-        for (size_t i = 0; i < res.size(); ++i) {
-            const auto& row = res[i];
-            std::cout << "\n--- Запись " << (i + 1) << " ---" << std::endl;
+        pqxx::nontransaction cleanup(*conn);
+        cleanup.exec("DROP SCHEMA IF EXISTS plan_check CASCADE");
+        cleanup.exec("SET search_path TO DEFAULT");
+        return plans;
+    }
 
-            for (size_t j = 0; j < row.size(); ++j) {
-                std::string col_name = res.column_name(j);
-                auto field = row[static_cast<int>(j)];
-                std::string value = field.is_null() ? "Нет данных" : field.c_str();
+    void write_baseline(const std::map<std::string, std::vector<PlanNode>>& plans) {
+        std::filesystem::path path(baseline_path);
+        if (path.has_parent_path()) {
+            std::filesystem::create_directories(path.parent_path());
+        }
 
-                std::string display_name = col_name;
-                if (col_name == "genre") display_name = "Жанр";
-                else if (col_name == "title") display_name = "Название";
-                else if (col_name == "published_year") display_name = "Год";
-                else if (col_name == "language") display_name = "Язык";
-                else if (col_name == "is_reference") display_name = "Справочное";
-                else if (col_name == "full_name") display_name = "ФИО";
-                else if (col_name == "country") display_name = "Страна";
-                else if (col_name == "book_count") display_name = "Книг";
-                else if (col_name == "author_count") display_name = "Авторов";
-                else if (col_name == "inventory_number") display_name = "Инвентарный номер";
-                else if (col_name == "location") display_name = "Местоположение";
-                else if (col_name == "status") display_name = "Статус";
-                else if (col_name == "loan_date") display_name = "Дата выдачи";
-                else if (col_name == "due_date") display_name = "Срок возврата";
-                else if (col_name == "return_date") display_name = "Дата возврата";
-                else if (col_name == "fine_amount") display_name = "Штраф";
-                else if (col_name == "days_overdue") display_name = "Дней просрочки";
-                else if (col_name == "loan_count") display_name = "Выдач";
-                else if (col_name == "reader") display_name = "Читатель";
-                else if (col_name == "book") display_name = "Книга";
+        std::ofstream out(baseline_path);
+        out << "# query@scale\tdepth\tnode_type\trelation\tindex\tplan_rows\tshared_buffers\n";
+        for (const auto& entry : plans) {
+            for (const auto& node : entry.second) {
+                out << entry.first << '\t' << node.depth << '\t' << node.node_type << '\t'
+                    << node.relation << '\t' << node.index << '\t'
+                    << static_cast<long long>(node.plan_rows) << '\t'
+                    << static_cast<long long>(node.buffers) << '\n';
+            }
+        }
+    }
 
-                std::cout << std::left << std::setw(30) << display_name + ":" << value << std::endl;
+    std::map<std::string, std::vector<PlanNode>> read_baseline() {
+        std::ifstream in(baseline_path);
+        if (!in) {
+            throw std::runtime_error("Нет файла базовых планов " + baseline_path +
+                                     " (создайте его: ./library_app --plan-baseline)");
+        }
+
+        std::map<std::string, std::vector<PlanNode>> plans;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') continue;
+
+            std::vector<std::string> cols;
+            size_t start = 0;
+            while (true) {
+                size_t tab = line.find('\t', start);
+                cols.push_back(line.substr(start, tab - start));
+                if (tab == std::string::npos) break;
+                start = tab + 1;
+            }
+            if (cols.size() != 7) {
+                throw std::runtime_error("Некорректная строка базовых планов: " + line);
             }
+            plans[cols[0]].push_back(PlanNode{
+                std::stoi(cols[1]), cols[2], cols[3], cols[4], std::stod(cols[5]), std::stod(cols[6])
+            });
         }
-        std::cout << std::endl;
+        return plans;
     }
 
-    void clearLine() {
-        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    bool within(double actual, double expected) const {
+        return std::fabs(actual - expected) <= tolerance * std::max(expected, 10.0);
+    }
+
+    static std::string describe(const PlanNode& node) {
+        std::string text = node.node_type;
+        if (node.relation != "-") text += " on " + node.relation;
+        if (node.index != "-") text += " using " + node.index;
+        return text;
     }
 
 public:
-    LibraryDB(const std::string& conn_str) : conn(nullptr) {
-        const int max_attempts = 20;
-        for (int attempt = 1; attempt <= max_attempts; ++attempt) {
-            try {
-                conn = new pqxx::connection(conn_str);
-                if (conn->is_open()) {
-                    std::cout << "Подключение к БД установлено" << std::endl;
-                    return;
+    PlanRegression(const std::string& conn_str, const std::vector<int>& scale_list,
+                   double allowed_deviation, const std::string& baseline)
+        : conn(connect_with_retry(conn_str)), scales(scale_list), tolerance(allowed_deviation),
+          baseline_path(baseline), statement_counter(0) {}
+
+    ~PlanRegression() {
+        delete conn;
+    }
+
+    int record() {
+        auto plans = capture();
+        write_baseline(plans);
+        std::cout << "Базовые планы записаны в " << baseline_path
+                  << " (" << plans.size() << " запросов)" << std::endl;
+        return 0;
+    }
+
+    int check() {
+        auto expected = read_baseline();
+        auto actual = capture();
+
+        int regressions = 0;
+        for (const auto& entry : expected) {
+            auto it = actual.find(entry.first);
+            if (it == actual.end()) {
+                std::cout << "[REGRESSION] " << entry.first << ": запрос не выполнялся" << std::endl;
+                ++regressions;
+                continue;
+            }
+
+            const auto& want = entry.second;
+            const auto& got = it->second;
+            bool same_shape = want.size() == got.size();
+            for (size_t i = 0; same_shape && i < want.size(); ++i) {
+                same_shape = want[i].depth == got[i].depth && want[i].node_type == got[i].node_type &&
+                             want[i].relation == got[i].relation && want[i].index == got[i].index;
+            }
+            if (!same_shape) {
+                std::cout << "[REGRESSION] " << entry.first << ": изменилась форма плана" << std::endl;
+                for (size_t i = 0; i < std::max(want.size(), got.size()); ++i) {
+                    std::cout << "    было: " << std::left << std::setw(50)
+                              << (i < want.size() ? std::string(want[i].depth * 2, ' ') + describe(want[i]) : "")
+                              << " стало: "
+                              << (i < got.size() ? std::string(got[i].depth * 2, ' ') + describe(got[i]) : "")
+                              << std::endl;
                 }
-            } catch (const std::exception &e) {
-                std::cerr << "Ошибка подключения (попытка " << attempt
-                          << "): " << e.what() << std::endl;
+                ++regressions;
+                continue;
             }
 
-            delete conn;
-            conn = nullptr;
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+            for (size_t i = 0; i < want.size(); ++i) {
+                if (!within(got[i].plan_rows, want[i].plan_rows)) {
+                    std::cout << "[REGRESSION] " << entry.first << ": " << describe(got[i])
+                              << " оценка строк " << want[i].plan_rows << " -> " << got[i].plan_rows << std::endl;
+                    ++regressions;
+                }
+                if (!within(got[i].buffers, want[i].buffers)) {
+                    std::cout << "[REGRESSION] " << entry.first << ": " << describe(got[i])
+                              << " буферы " << want[i].buffers << " -> " << got[i].buffers << std::endl;
+                    ++regressions;
+                }
+            }
         }
 
-        std::cerr << "Не удалось подключиться к БД после " << max_attempts << " попыток" << std::endl;
-        exit(1);
+        for (const auto& entry : actual) {
+            if (expected.count(entry.first) == 0) {
+                std::cout << "[NEW] " << entry.first << ": нет базового плана" << std::endl;
+            }
+        }
+
+        std::cout << "Проверено планов: " << expected.size() << ", регрессий: " << regressions << std::endl;
+        return regressions == 0 ? 0 : 1;
     }
+};
 
-    ~LibraryDB() {
-        delete conn;
+class ConnectionPool {
+private:
+    std::string conn_str;
+    std::vector<pqxx::connection*> idle;
+    std::mutex mutex;
+    std::condition_variable available;
+
+    void release(pqxx::connection* conn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            idle.push_back(conn);
+        }
+        available.notify_one();
     }
 
-    void execute(const std::string& sql) {
-        try {
-            pqxx::work txn(*conn);
-            txn.exec(sql);
-            txn.commit();
-        } catch (const std::exception &e) {
-            std::cerr << "Ошибка: " << e.what() << std::endl;
+public:
+    class Lease {
+    private:
+        ConnectionPool* pool;
+        pqxx::connection* conn;
+
+    public:
+        Lease(ConnectionPool* owner, pqxx::connection* leased) : pool(owner), conn(leased) {}
+
+        Lease(Lease&& other) noexcept : pool(other.pool), conn(other.conn) {
+            other.pool = nullptr;
+        }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease& operator=(Lease&&) = delete;
+
+        ~Lease() {
+            if (pool) pool->release(conn);
+        }
+
+        pqxx::connection& operator*() const {
+            return *conn;
+        }
+    };
+
+    ConnectionPool(const std::string& conn_string, size_t size) : conn_str(conn_string) {
+        for (size_t i = 0; i < size; ++i) {
+            idle.push_back(connect_with_retry(conn_str));
         }
     }
 
-    pqxx::result query(const std::string& sql) {
-        try {
-            pqxx::work txn(*conn);
-            pqxx::result res = txn.exec(sql);
-            txn.commit();
-            return res;
-        } catch (const std::exception &e) {
-            std::cerr << "Ошибка запроса: " << e.what() << std::endl;
-            throw;
+    ~ConnectionPool() {
+        for (auto* conn : idle) {
+            delete conn;
         }
     }
 
-    void query1_books_by_genre(const std::string& genre) {
-        std::string sql = "SELECT b.title, g.genre, b.published_year, b.language, "
-                          "CASE WHEN b.is_reference THEN 'Да' ELSE 'Нет' END as is_reference "
-                          "FROM books b "
-                          "JOIN genres g ON b.genre_id = g.genre_id "
-                          "WHERE g.genre = '" + genre + "' "
-                          "ORDER BY b.title";
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "1. Книги жанра: " << genre << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        try {
-            auto res = query(sql);
-            printResult(res);
-        } catch (...) {}
+    Lease acquire() {
+        pqxx::connection* conn;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this]() { return !idle.empty(); });
+            conn = idle.back();
+            idle.pop_back();
+        }
+
+        if (!conn || !conn->is_open()) {
+            delete conn;
+            try {
+                conn = new pqxx::connection(conn_str);
+            } catch (...) {
+                release(nullptr);
+                throw;
+            }
+        }
+        return Lease(this, conn);
     }
+};
 
-    void query2_books_with_multiple_authors() {
-        std::string sql = "SELECT b.title, COUNT(ba.author_id) as author_count "
-                          "FROM books b "
-                          "JOIN book_authors ba ON b.book_id = ba.book_id "
-                          "GROUP BY b.book_id, b.title "
-                          "HAVING COUNT(ba.author_id) > 1 "
-                          "ORDER BY author_count DESC, b.title";
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "2. Книги с несколькими авторами" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        try {
-            auto res = query(sql);
-            printResult(res);
-        } catch (...) {}
+class ServiceClient {
+private:
+    int fd;
+    std::mutex write_mutex;
+    bool open;
+
+public:
+    std::string buffer;
+
+    explicit ServiceClient(int socket_fd) : fd(socket_fd), open(true) {}
+
+    ~ServiceClient() {
+        ::close(fd);
     }
 
-    void query3_authors_book_count() {
-        std::string sql = "SELECT a.full_name, COUNT(ba.book_id) as book_count "
-                          "FROM authors a "
-                          "LEFT JOIN book_authors ba ON a.author_id = ba.author_id "
-                          "GROUP BY a.author_id, a.full_name "
-                          "ORDER BY book_count DESC, a.full_name";
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "3. Авторы и количество книг" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        try {
-            auto res = query(sql);
-            printResult(res);
-        } catch (...) {}
+    ServiceClient(const ServiceClient&) = delete;
+    ServiceClient& operator=(const ServiceClient&) = delete;
+
+    void send(const std::string& data) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        if (!open) return;
+
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                shutdown(fd, SHUT_RDWR);
+                open = false;
+                return;
+            }
+            sent += static_cast<size_t>(n);
+        }
     }
 
-    void query4_available_copies_by_title(const std::string& title) {
-        std::string sql = "SELECT b.title, c.inventory_number, c.location "
-                          "FROM copies c "
-                          "JOIN books b ON c.book_id = b.book_id "
-                          "WHERE b.title = '" + title + "' AND c.status = 'in_stock' "
-                          "ORDER BY c.inventory_number";
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "4. Доступные экземпляры: " << title << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        try {
-            auto res = query(sql);
-            printResult(res);
-        } catch (...) {}
+    void stop_reading() {
+        shutdown(fd, SHUT_RD);
     }
+};
 
-    void query5_active_loans() {
-        std::string sql = "SELECT r.full_name as reader, b.title as book, "
-                          "c.inventory_number, l.loan_date, l.due_date "
-                          "FROM loans l "
-                          "JOIN readers r ON l.reader_id = r.reader_id "
-                          "JOIN copies c ON l.copy_id = c.copy_id "
-                          "JOIN books b ON c.book_id = b.book_id "
-                          "WHERE l.return_date IS NULL "
-                          "ORDER BY l.due_date, r.full_name";
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "5. Текущие выдачи" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        try {
-            auto res = query(sql);
-            printResult(res);
-        } catch (...) {}
+struct ServiceRequest {
+    std::shared_ptr<ServiceClient> client;
+    JsonValue message;
+    std::string error;
+};
+
+class RequestQueue {
+private:
+    std::deque<ServiceRequest> items;
+    size_t capacity;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+
+public:
+    explicit RequestQueue(size_t max_items) : capacity(max_items), closed(false) {}
+
+    bool try_push(ServiceRequest& request) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed || items.size() >= capacity) return false;
+            items.push_back(std::move(request));
+        }
+        not_empty.notify_one();
+        return true;
     }
 
-    void query6_overdue_loans() {
-        std::string sql = "SELECT r.full_name as reader, b.title as book, "
-                          "l.due_date, (CURRENT_DATE - l.due_date) as days_overdue, "
-                          "l.fine_amount "
-                          "FROM loans l "
-                          "JOIN readers r ON l.reader_id = r.reader_id "
-                          "JOIN copies c ON l.copy_id = c.copy_id "
-                          "JOIN books b ON c.book_id = b.book_id "
-                          "WHERE l.return_date IS NULL AND l.due_date < CURRENT_DATE "
-                          "ORDER BY days_overdue DESC";
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "6. Просроченные выдачи" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        try {
-            auto res = query(sql);
-            printResult(res);
-        } catch (...) {}
+    bool has_room() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size() < capacity;
     }
 
-    void query7_popular_genres() {
-        std::string sql = "SELECT g.genre, COUNT(l.loan_id) as loan_count "
-                          "FROM loans l "
-                          "JOIN copies c ON l.copy_id = c.copy_id "
-                          "JOIN books b ON c.book_id = b.book_id "
-                          "JOIN genres g ON b.genre_id = g.genre_id "
-                          "GROUP BY g.genre "
-                          "ORDER BY loan_count DESC, g.genre";
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "7. Популярные жанры (по выдачам)" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        try {
-            auto res = query(sql);
-            printResult(res);
-        } catch (...) {}
+    bool pop(ServiceRequest& request) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this]() { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        request = std::move(items.front());
+        items.pop_front();
+        return true;
     }
 
-    void query8_return_book(int loan_id) {
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "8. Возврат книги (loan_id = " << loan_id << ")" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        not_empty.notify_all();
+    }
+};
 
-        try {
-            pqxx::work txn(*conn);
-            pqxx::result updated = txn.exec_params(
-                "UPDATE loans "
-                "SET return_date = CURRENT_DATE, "
-                "fine_amount = GREATEST(0, CURRENT_DATE - due_date) * 10 "
-                "WHERE loan_id = $1 AND return_date IS NULL "
-                "RETURNING loan_id, copy_id",
-                loan_id
-            );
+class LibraryService {
+private:
+    static constexpr size_t max_line_bytes = 64 * 1024;
 
-            if (updated.empty()) {
-                std::cout << "Выдача не найдена или уже закрыта" << std::endl;
-                txn.commit();
-                return;
+    struct Shard {
+        std::string branch;
+        std::unique_ptr<ConnectionPool> pool;
+        std::unique_ptr<HoldQueues> hold_queues;
+    };
+
+    using Leases = std::vector<std::optional<ConnectionPool::Lease>>;
+
+    std::vector<Shard> shards;
+    QueryWatchdog watchdog;
+    ReaderSummaries summaries;
+    OpLimits interactive_limits;
+    OpLimits report_limits;
+    OpLimits write_limits;
+    int hold_pickup_days;
+    int hold_wait_days;
+    size_t worker_count;
+    RequestQueue requests;
+    std::atomic<long> handled;
+
+    pqxx::connection& leaseFor(Leases& leases, size_t shard) {
+        if (!leases[shard]) {
+            leases[shard].emplace(shards[shard].pool->acquire());
+        }
+        return **leases[shard];
+    }
+
+    static std::string requireString(const JsonValue& request, const std::string& key) {
+        const JsonValue* value = request.find(key);
+        if (!value || value->type != JsonValue::Type::String) {
+            throw std::runtime_error("Не задано строковое поле \"" + key + "\"");
+        }
+        return value->text;
+    }
+
+    static int requireInt(const JsonValue& request, const std::string& key) {
+        const JsonValue* value = request.find(key);
+        if (!value || value->type != JsonValue::Type::Number) {
+            throw std::runtime_error("Не задано целое поле \"" + key + "\"");
+        }
+        if (!std::isfinite(value->number) || value->number != std::floor(value->number) ||
+            value->number < std::numeric_limits<int>::min() || value->number > std::numeric_limits<int>::max()) {
+            throw std::runtime_error("Поле \"" + key + "\" должно быть целым числом в диапазоне int");
+        }
+        return static_cast<int>(value->number);
+    }
+
+    static JsonValue tableBody(const ResultTable& table) {
+        JsonValue body = JsonValue::make_object();
+        JsonValue& columns = body.set("columns", JsonValue::make_array());
+        for (const auto& column : table.columns) {
+            columns.push(JsonValue::make_string(column));
+        }
+        JsonValue& rows = body.set("rows", JsonValue::make_array());
+        for (const auto& row : table.rows) {
+            JsonValue values = JsonValue::make_array();
+            for (const auto& field : row) {
+                values.push(field ? JsonValue::make_string(*field) : JsonValue());
             }
+            rows.push(values);
+        }
+        return body;
+    }
 
-            int copy_id = updated[0]["copy_id"].as<int>();
-            txn.exec_params("UPDATE copies SET status = 'in_stock' WHERE copy_id = $1", copy_id);
+    ResultTable runOn(Leases& leases, size_t shard, const std::string& sql, const OpLimits& limits) {
+        pqxx::connection& conn = leaseFor(leases, shard);
+        BoundedOperation op(watchdog, conn, limits);
+        pqxx::work txn(conn);
+        op.apply(txn);
+        ResultTable table = ResultTable::from_result(txn.exec(sql));
+        txn.commit();
+        return table;
+    }
 
-            pqxx::result info = txn.exec_params(
-                "SELECT l.loan_id, r.full_name as reader, b.title as book, "
-                "l.due_date, l.return_date, l.fine_amount "
-                "FROM loans l "
-                "JOIN readers r ON l.reader_id = r.reader_id "
-                "JOIN copies c ON l.copy_id = c.copy_id "
-                "JOIN books b ON c.book_id = b.book_id "
-                "WHERE l.loan_id = $1",
-                loan_id
-            );
-            txn.commit();
-            printResult(info);
-        } catch (const std::exception &e) {
-            std::cerr << "Ошибка: " << e.what() << std::endl;
+    std::vector<ResultTable> scatter(Leases& leases, const std::string& sql, const OpLimits& limits,
+                                     bool with_branch) {
+        std::vector<pqxx::connection*> conns;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            conns.push_back(&leaseFor(leases, i));
+        }
+
+        std::vector<ResultTable> parts = scatter_query(conns, watchdog, limits, sql);
+        if (with_branch && shards.size() > 1) {
+            for (size_t i = 0; i < parts.size(); ++i) {
+                add_branch_column(parts[i], shards[i].branch);
+            }
         }
+        return parts;
     }
 
-    void query9_add_reader() {
-        std::string full_name, group, email, status;
+    JsonValue search(const JsonValue& request, Leases& leases) {
+        pqxx::connection& conn = leaseFor(leases, 0);
+        BoundedOperation op(watchdog, conn, interactive_limits);
+        pqxx::work txn(conn);
+        op.apply(txn);
+        pqxx::result res = txn.exec_params(LibrarySql::search_books(), "%" + requireString(request, "title") + "%");
+        txn.commit();
+        return tableBody(ResultTable::from_result(res));
+    }
 
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "9. Добавление читателя" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
+    JsonValue issue(const JsonValue& request, Leases& leases) {
+        int reader_id = requireInt(request, "reader_id");
+        int copy_id = requireInt(request, "copy_id");
+        std::string due_date = requireString(request, "due_date");
+        size_t shard = shard_for_id(copy_id, shards.size());
+        pqxx::connection& conn = leaseFor(leases, shard);
 
-        std::cout << "ФИО: ";
-        clearLine();
-        std::getline(std::cin, full_name);
-        std::cout << "Группа (опционально): ";
-        std::getline(std::cin, group);
-        std::cout << "Email (опционально): ";
-        std::getline(std::cin, email);
-        std::cout << "Статус (active/inactive), по умолчанию active: ";
-        std::getline(std::cin, status);
-        if (status.empty()) {
-            status = "active";
+        std::optional<IssueOutcome> outcome;
+        {
+            BoundedOperation op(watchdog, conn, write_limits);
+            pqxx::work txn(conn);
+            op.apply(txn);
+            outcome = LoanOps::issue_loan(txn, reader_id, copy_id, due_date, hold_wait_days, hold_pickup_days);
+            txn.commit();
         }
 
-        try {
-            pqxx::work txn(*conn);
-            std::string sql =
-                "INSERT INTO readers (full_name, \"group\", email, status) VALUES (" +
-                txn.quote(full_name) + ", " +
-                (group.empty() ? "NULL" : txn.quote(group)) + ", " +
-                (email.empty() ? "NULL" : txn.quote(email)) + ", " +
-                txn.quote(status) + ") "
-                "RETURNING reader_id, full_name, status";
-            pqxx::result res = txn.exec(sql);
+        JsonValue body = JsonValue::make_object();
+        if (outcome->status == IssueOutcome::Status::NotFound) {
+            throw std::runtime_error("Экземпляр не найден");
+        }
+        HoldQueues& hold_queues = *shards[shard].hold_queues;
+        if (outcome->status == IssueOutcome::Status::Issued) {
+            hold_queues.invalidate(outcome->book_id);
+            body.set("status", JsonValue::make_string("issued"));
+            body.set("loan_id", JsonValue::make_number(std::stod(outcome->loan_id)));
+            return body;
+        }
+
+        if (!outcome->assigned.empty()) {
+            hold_queues.erase(outcome->book_id, outcome->assigned[0]["hold_id"].as<int>());
+        }
+        if (!outcome->hold.empty()) {
+            hold_queues.push(outcome->book_id, HoldEntry{
+                outcome->hold[0]["created_us"].as<long long>(), outcome->hold[0]["hold_id"].as<int>(), reader_id
+            });
+        }
+        if (!hold_queues.is_fresh(outcome->book_id)) {
+            BoundedOperation op(watchdog, conn, interactive_limits);
+            pqxx::work txn(conn);
+            op.apply(txn);
+            hold_queues.replace(outcome->book_id, load_waiting_holds(txn, outcome->book_id));
             txn.commit();
-            printResult(res);
-        } catch (const std::exception &e) {
-            std::cerr << "Ошибка: " << e.what() << std::endl;
         }
+        auto position = hold_queues.position(outcome->book_id, reader_id);
+
+        body.set("status", JsonValue::make_string("queued"));
+        body.set("copy_status", JsonValue::make_string(outcome->copy_status));
+        body.set("title", JsonValue::make_string(outcome->title));
+        body.set("position", JsonValue::make_number(static_cast<double>(position.first)));
+        body.set("queue_length", JsonValue::make_number(static_cast<double>(position.second)));
+        return body;
     }
 
-    void query10_issue_loan(int reader_id, int copy_id, const std::string& due_date) {
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "10. Выдать книгу" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
+    JsonValue returnLoan(const JsonValue& request, Leases& leases) {
+        int loan_id = requireInt(request, "loan_id");
+        size_t shard = shard_for_id(loan_id, shards.size());
+        pqxx::connection& conn = leaseFor(leases, shard);
 
-        try {
-            pqxx::work txn(*conn);
-            pqxx::result copy = txn.exec_params(
-                "SELECT c.copy_id, c.status, b.title "
-                "FROM copies c "
-                "JOIN books b ON c.book_id = b.book_id "
-                "WHERE c.copy_id = $1 FOR UPDATE",
-                copy_id
-            );
+        BoundedOperation op(watchdog, conn, write_limits);
+        pqxx::work txn(conn);
+        op.apply(txn);
+        ReturnOutcome outcome = LoanOps::return_loan(txn, loan_id, hold_pickup_days);
+        txn.commit();
 
-            if (copy.empty()) {
-                std::cout << "Экземпляр не найден" << std::endl;
-                txn.commit();
-                return;
-            }
+        if (!outcome.found) {
+            throw std::runtime_error("Выдача не найдена или уже закрыта");
+        }
 
-            std::string status = copy[0]["status"].c_str();
-            if (status != "in_stock") {
-                std::cout << "Экземпляр недоступен (status = " << status << ")" << std::endl;
-                txn.commit();
-                return;
-            }
+        JsonValue body = tableBody(ResultTable::from_result(outcome.info));
+        if (!outcome.assigned.empty()) {
+            const auto& hold = outcome.assigned[0];
+            shards[shard].hold_queues->erase(hold["book_id"].as<int>(), hold["hold_id"].as<int>());
+            JsonValue& assigned = body.set("hold", JsonValue::make_object());
+            assigned.set("hold_id", JsonValue::make_number(hold["hold_id"].as<int>()));
+            assigned.set("reader_id", JsonValue::make_number(hold["reader_id"].as<int>()));
+            assigned.set("expires_at", JsonValue::make_string(hold["expires_at"].c_str()));
+        }
+        return body;
+    }
 
-            pqxx::result res = txn.exec_params(
-                "INSERT INTO loans (reader_id, copy_id, due_date) "
-                "VALUES ($1, $2, $3) "
-                "RETURNING loan_id",
-                reader_id,
-                copy_id,
-                due_date
-            );
+    JsonValue registerReader(const JsonValue& request, Leases& leases) {
+        std::string full_name = requireString(request, "full_name");
+        std::string group = request.get_string("group");
+        std::string email = request.get_string("email");
+        std::string status = request.get_string("status", "active");
 
-            txn.exec_params("UPDATE copies SET status = 'loaned' WHERE copy_id = $1", copy_id);
+        pqxx::result res;
+        pqxx::result full;
+        {
+            pqxx::connection& conn = leaseFor(leases, 0);
+            BoundedOperation op(watchdog, conn, write_limits);
+            pqxx::work txn(conn);
+            op.apply(txn);
+            res = txn.exec(LibrarySql::insert_reader(txn, full_name, group, email, status));
+            full = txn.exec_params("SELECT * FROM readers WHERE reader_id = $1", res[0]["reader_id"].as<int>());
             txn.commit();
-
-            std::cout << "Выдача создана. loan_id = " << res[0]["loan_id"].c_str() << std::endl;
-        } catch (const std::exception &e) {
-            std::cerr << "Ошибка: " << e.what() << std::endl;
         }
-    }
 
-    void injection1_vulnerable_login() {
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "SQL-инъекция 1: Уязвимый логин" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        std::cout << "Уязвимый запрос:" << std::endl;
-        std::cout << "SELECT * FROM readers WHERE email = '$email' AND status = '$status'" << std::endl;
-        std::cout << "\nАтака:" << std::endl;
-        std::cout << "Email: any' OR '1'='1" << std::endl;
-        std::cout << "Status: любой" << std::endl;
-        std::cout << "\nИтоговый SQL:" << std::endl;
-        std::cout << "SELECT * FROM readers WHERE email = 'any' OR '1'='1' AND status = 'любой'" << std::endl;
-        std::cout << "\nРезультат: выдаст всех читателей" << std::endl;
+        std::vector<pqxx::connection*> replicas;
+        for (size_t i = 1; i < shards.size(); ++i) {
+            replicas.push_back(&leaseFor(leases, i));
+        }
+        replicate_rows(leaseFor(leases, 0), replicas, watchdog, write_limits, "readers", "reader_id", full);
+        return tableBody(ResultTable::from_result(res));
     }
 
-    void injection2_vulnerable_search() {
-        std::string search = "%' OR '1'='1";
-        std::string sql = "SELECT * FROM books WHERE title LIKE '%" + search + "%'";
-
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "SQL-инъекция 2: Уязвимый поиск" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        std::cout << "Пользовательский ввод: " << search << std::endl;
-        std::cout << "\nСформированный SQL:" << std::endl;
-        std::cout << sql << std::endl;
-        std::cout << "\nРезультат: покажет ВСЕ книги" << std::endl;
+    JsonValue report(const JsonValue& request, Leases& leases) {
+        std::string name = requireString(request, "name");
+        pqxx::connection& primary = leaseFor(leases, 0);
 
-        try {
-            auto res = query(sql);
-            std::cout << "\nНайдено записей: " << res.size() << std::endl;
-        } catch (...) {}
+        if (name == "books_by_genre") {
+            std::string sql = LibrarySql::books_by_genre(primary.esc(requireString(request, "genre")));
+            return tableBody(runOn(leases, 0, sql, interactive_limits));
+        }
+        if (name == "books_with_multiple_authors") {
+            return tableBody(runOn(leases, 0, LibrarySql::books_with_multiple_authors(), report_limits));
+        }
+        if (name == "authors_book_count") {
+            return tableBody(runOn(leases, 0, LibrarySql::authors_book_count(), report_limits));
+        }
+        if (name == "available_copies") {
+            std::string sql = LibrarySql::available_copies_by_title(primary.esc(requireString(request, "title")));
+            return tableBody(merge_sorted(scatter(leases, sql, interactive_limits, true),
+                                          ReportOrder::available_copies()));
+        }
+        if (name == "active_loans") {
+            return tableBody(merge_sorted(scatter(leases, LibrarySql::active_loans(), report_limits, true),
+                                          ReportOrder::active_loans()));
+        }
+        if (name == "overdue_loans") {
+            return tableBody(merge_sorted(scatter(leases, LibrarySql::overdue_loans(), report_limits, true),
+                                          ReportOrder::overdue_loans()));
+        }
+        if (name == "popular_genres") {
+            return tableBody(combine_counts(scatter(leases, LibrarySql::popular_genres(), report_limits, false), 0, 1));
+        }
+        throw std::runtime_error("Неизвестный отчет: " + name);
     }
 
-    void injection3_union_attack() {
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "SQL-инъекция 3: UNION-атака" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        std::cout << "Уязвимый запрос:" << std::endl;
-        std::cout << "SELECT title, published_year FROM books WHERE book_id = $id" << std::endl;
-        std::cout << "\nАтака (id):" << std::endl;
-        std::cout << "1 UNION SELECT full_name, 0 FROM readers" << std::endl;
-        std::cout << "\nИтоговый SQL:" << std::endl;
-        std::cout << "SELECT title, published_year FROM books WHERE book_id = 1 UNION SELECT full_name, 0 FROM readers" << std::endl;
-        std::cout << "\nРезультат: получаем список читателей" << std::endl;
+    JsonValue readerCard(const JsonValue& request) {
+        int reader_id = requireInt(request, "reader_id");
+        return tableBody(reader_cards_table({summaries.card(reader_id, local_date_today())}));
     }
 
-    void injection4_error_based() {
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "SQL-инъекция 4: Error-based" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        std::cout << "Уязвимый запрос:" << std::endl;
-        std::cout << "SELECT * FROM books WHERE book_id = $id" << std::endl;
-        std::cout << "\nАтака (id):" << std::endl;
-        std::cout << "1 AND 1=CAST((SELECT version()) AS INT)" << std::endl;
-        std::cout << "\nРезультат: ошибка БД покажет версию PostgreSQL" << std::endl;
+    JsonValue summaryCheck(Leases& leases) {
+        if (!summaries.is_ready()) {
+            throw std::runtime_error("Сводки читателей еще загружаются");
+        }
+
+        SummaryCheck result = summaries.check([this, &leases]() {
+            return scatter(leases, LibrarySql::reader_summaries(), report_limits, false);
+        }, std::chrono::milliseconds(report_limits.deadline_ms));
+        JsonValue body = JsonValue::make_object();
+        body.set("checked", JsonValue::make_number(static_cast<double>(result.checked)));
+        body.set("busy", JsonValue::make_number(static_cast<double>(result.busy)));
+        JsonValue& readers = body.set("mismatched", JsonValue::make_array());
+        for (const auto& mismatch : result.mismatches) {
+            readers.push(JsonValue::make_number(mismatch.first.reader_id));
+        }
+        JsonValue& reloaded = body.set("reloaded", JsonValue::make_array());
+        for (size_t shard : result.shards) {
+            summaries.reload(shard);
+            reloaded.push(JsonValue::make_string(shards[shard].branch));
+        }
+        return body;
     }
 
-    void injection5_time_based() {
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "SQL-инъекция 5: Time-based (Blind)" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-        std::cout << "Уязвимый запрос:" << std::endl;
-        std::cout << "SELECT * FROM readers WHERE email = '$email'" << std::endl;
-        std::cout << "\nАтака (email):" << std::endl;
-        std::cout << "test' AND (SELECT pg_sleep(5))--" << std::endl;
-        std::cout << "\nРезультат: если ответ задерживается 5 сек, значит запись существует" << std::endl;
+    static JsonValue errorResponse(const std::string& message) {
+        JsonValue response = JsonValue::make_object();
+        response.set("ok", JsonValue::make_bool(false));
+        response.set("error", JsonValue::make_string(message));
+        return response;
     }
 
-    void safe_search_books(const std::string& search_term) {
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "Безопасный поиск книги" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
+    JsonValue handle(const JsonValue& request, Leases& leases) {
+        JsonValue response = JsonValue::make_object();
+        if (const JsonValue* id = request.find("id")) {
+            response.set("id", *id);
+        }
 
         try {
-            pqxx::work txn(*conn);
-            std::string pattern = "%" + search_term + "%";
-            std::string sql = "SELECT title, published_year, language "
-                              "FROM books WHERE title ILIKE " + txn.quote(pattern);
-            pqxx::result res = txn.exec(sql);
-            txn.commit();
+            std::string op = request.get_string("op");
+            JsonValue body = JsonValue::make_object();
+            if (op == "search") {
+                body = search(request, leases);
+            } else if (op == "issue") {
+                body = issue(request, leases);
+            } else if (op == "return") {
+                body = returnLoan(request, leases);
+            } else if (op == "register_reader") {
+                body = registerReader(request, leases);
+            } else if (op == "report") {
+                body = report(request, leases);
+            } else if (op == "reader_card") {
+                body = readerCard(request);
+            } else if (op == "summary_check") {
+                body = summaryCheck(leases);
+            } else if (op != "ping") {
+                throw std::runtime_error("Неизвестная операция: " + op);
+            }
 
-            std::cout << "Поиск: " << search_term << std::endl;
-            std::cout << "Найдено записей: " << res.size() << std::endl;
-            printResult(res);
+            response.set("ok", JsonValue::make_bool(true));
+            for (const auto& field : body.fields) {
+                response.set(field.first, field.second);
+            }
         } catch (const std::exception &e) {
-            std::cerr << "Ошибка: " << e.what() << std::endl;
+            for (const auto& field : errorResponse(e.what()).fields) {
+                response.set(field.first, field.second);
+            }
         }
+        return response;
     }
 
-    void safe_insert_book() {
-        std::string title, isbn, language, year_str, ref_str;
-        int genre_id;
-
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "Безопасное добавление книги" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-
-        std::cout << "Название: ";
-        clearLine();
-        std::getline(std::cin, title);
-        std::cout << "ID жанра: ";
-        std::cin >> genre_id;
-        std::cout << "ISBN (опционально): ";
-        clearLine();
-        std::getline(std::cin, isbn);
-        std::cout << "Год издания (опционально): ";
-        std::getline(std::cin, year_str);
-        std::cout << "Язык (опционально): ";
-        std::getline(std::cin, language);
-        std::cout << "Справочная книга? (да/нет): ";
-        std::getline(std::cin, ref_str);
+    void workerLoop() {
+        ServiceRequest request;
+        while (requests.pop(request)) {
+            JsonValue response;
+            if (request.error.empty()) {
+                Leases leases(shards.size());
+                response = handle(request.message, leases);
+            } else {
+                response = errorResponse(request.error);
+            }
+            request.client->send(response.dump() + "\n");
+            request.client.reset();
+            handled.fetch_add(1);
+        }
+    }
 
-        try {
-            pqxx::work txn(*conn);
-            bool is_reference = (ref_str == "да" || ref_str == "Да" || ref_str == "yes" || ref_str == "y");
+    static int openListener(const std::string& address, std::string& unix_path) {
+        int fd;
+        if (address.rfind("unix:", 0) == 0) {
+            unix_path = address.substr(5);
+            sockaddr_un addr{};
+            if (unix_path.size() >= sizeof(addr.sun_path)) {
+                throw std::runtime_error("Слишком длинный путь сокета: " + unix_path);
+            }
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, unix_path.c_str(), sizeof(addr.sun_path) - 1);
+            unlink(unix_path.c_str());
 
-            std::string sql =
-                "INSERT INTO books (genre_id, title, isbn, published_year, language, is_reference) VALUES (" +
-                txn.quote(genre_id) + ", " +
-                txn.quote(title) + ", " +
-                (isbn.empty() ? "NULL" : txn.quote(isbn)) + ", " +
-                (year_str.empty() ? "NULL" : txn.quote(std::stoi(year_str))) + ", " +
-                (language.empty() ? "NULL" : txn.quote(language)) + ", " +
-                txn.quote(is_reference) + ") "
-                "RETURNING book_id, title";
+            fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                throw std::runtime_error("Не удалось открыть " + address + ": " + std::strerror(errno));
+            }
+        } else {
+            size_t colon = address.rfind(':');
+            if (colon == std::string::npos) {
+                throw std::runtime_error("Адрес должен иметь вид host:port или unix:/path: " + address);
+            }
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<uint16_t>(std::stoi(address.substr(colon + 1))));
+            if (inet_pton(AF_INET, address.substr(0, colon).c_str(), &addr.sin_addr) != 1) {
+                throw std::runtime_error("Некорректный IPv4-адрес: " + address);
+            }
 
-            pqxx::result res = txn.exec(sql);
-            txn.commit();
+            fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            int reuse = 1;
+            if (fd >= 0) {
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            }
+            if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                throw std::runtime_error("Не удалось открыть " + address + ": " + std::strerror(errno));
+            }
+        }
 
-            std::cout << "\nКнига успешно добавлена!" << std::endl;
-            std::cout << "ID: " << res[0]["book_id"].c_str() << std::endl;
-            std::cout << "Название: " << res[0]["title"].c_str() << std::endl;
-        } catch (const std::exception &e) {
-            std::cerr << "Ошибка: " << e.what() << std::endl;
+        if (listen(fd, 128) < 0) {
+            throw std::runtime_error("listen: " + std::string(std::strerror(errno)));
         }
+        return fd;
     }
 
-    void init_database() {
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "Инициализация базы данных" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
-
-        try {
-            pqxx::work txn(*conn);
-
-            std::vector<std::string> tables = {
-                "CREATE TABLE IF NOT EXISTS genres ("
-                "genre_id SERIAL PRIMARY KEY,"
-                "genre VARCHAR(100) NOT NULL UNIQUE)",
-
-                "CREATE TABLE IF NOT EXISTS authors ("
-                "author_id SERIAL PRIMARY KEY,"
-                "full_name VARCHAR(200) NOT NULL,"
-                "country VARCHAR(100))",
-
-                "CREATE TABLE IF NOT EXISTS readers ("
-                "reader_id SERIAL PRIMARY KEY,"
-                "full_name VARCHAR(200) NOT NULL,"
-                "\"group\" VARCHAR(50),"
-                "email VARCHAR(150) UNIQUE,"
-                "status VARCHAR(50) NOT NULL DEFAULT 'active',"
-                "registration_date DATE NOT NULL DEFAULT CURRENT_DATE)",
-
-                "CREATE TABLE IF NOT EXISTS books ("
-                "book_id SERIAL PRIMARY KEY,"
-                "genre_id INT REFERENCES genres(genre_id),"
-                "title VARCHAR(255) NOT NULL,"
-                "isbn VARCHAR(32) UNIQUE,"
-                "published_year INT,"
-                "language VARCHAR(50),"
-                "is_reference BOOLEAN NOT NULL DEFAULT FALSE)",
-
-                "CREATE TABLE IF NOT EXISTS book_authors ("
-                "book_id INT NOT NULL REFERENCES books(book_id) ON DELETE CASCADE,"
-                "author_id INT NOT NULL REFERENCES authors(author_id) ON DELETE CASCADE,"
-                "PRIMARY KEY (book_id, author_id))",
-
-                "CREATE TABLE IF NOT EXISTS copies ("
-                "copy_id SERIAL PRIMARY KEY,"
-                "book_id INT NOT NULL REFERENCES books(book_id) ON DELETE CASCADE,"
-                "inventory_number VARCHAR(50) UNIQUE,"
-                "location VARCHAR(100),"
-                "status VARCHAR(50) NOT NULL DEFAULT 'in_stock')",
-
-                "CREATE TABLE IF NOT EXISTS loans ("
-                "loan_id SERIAL PRIMARY KEY,"
-                "reader_id INT NOT NULL REFERENCES readers(reader_id),"
-                "copy_id INT NOT NULL REFERENCES copies(copy_id),"
-                "loan_date DATE NOT NULL DEFAULT CURRENT_DATE,"
-                "due_date DATE NOT NULL,"
-                "return_date DATE,"
-                "fine_amount NUMERIC(10,2) NOT NULL DEFAULT 0)"
-            };
+    enum class ReadState { Open, Paused, Closed };
 
-            for (const auto& sql : tables) {
-                txn.exec(sql);
+    ReadState queueLines(const std::shared_ptr<ServiceClient>& client) {
+        ReadState state = ReadState::Open;
+        size_t start = 0;
+        size_t newline;
+        while ((newline = client->buffer.find('\n', start)) != std::string::npos) {
+            std::string line = client->buffer.substr(start, newline - start);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty()) {
+                ServiceRequest request{client, JsonValue(), ""};
+                try {
+                    request.message = JsonValue::parse(line);
+                } catch (const std::exception &e) {
+                    request.error = e.what();
+                }
+                if (!requests.try_push(request)) {
+                    state = ReadState::Paused;
+                    break;
+                }
             }
+            start = newline + 1;
+        }
+        client->buffer.erase(0, start);
 
-            txn.commit();
-            std::cout << "Таблицы созданы успешно!" << std::endl;
-        } catch (const std::exception &e) {
-            std::cerr << "Ошибка: " << e.what() << std::endl;
+        if (state == ReadState::Open && client->buffer.size() > max_line_bytes) {
+            ServiceRequest request{client, JsonValue(), "Слишком длинная строка запроса"};
+            requests.try_push(request);
+            return ReadState::Closed;
         }
+        return state;
     }
 
-    void seed_data() {
-        std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "Заполнение тестовыми данными" << std::endl;
-        std::cout << "═══════════════════════════════════════════" << std::endl;
+    ReadState readClient(const std::shared_ptr<ServiceClient>& client, int fd) {
+        char chunk[4096];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n == 0) return ReadState::Closed;
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? ReadState::Open : ReadState::Closed;
+        }
+        client->buffer.append(chunk, static_cast<size_t>(n));
+        return queueLines(client);
+    }
 
-        try {
-            pqxx::work cleanup(*conn);
-            cleanup.exec("TRUNCATE loans, copies, book_authors, books, authors, readers, genres CASCADE");
-            cleanup.commit();
+public:
+    LibraryService(const std::vector<ShardConfig>& shard_configs, size_t workers, size_t queue_size)
+        : watchdog(shard_configs.front().conn_str),
+          summaries(shard_configs),
+          interactive_limits(op_limits_from_env("TIMEOUT_INTERACTIVE_MS", "5000", "LOCK_TIMEOUT_INTERACTIVE_MS", "2000")),
+          report_limits(op_limits_from_env("TIMEOUT_REPORT_MS", "30000", "LOCK_TIMEOUT_REPORT_MS", "5000")),
+          write_limits(op_limits_from_env("TIMEOUT_WRITE_MS", "10000", "LOCK_TIMEOUT_WRITE_MS", "2000")),
+          hold_pickup_days(std::stoi(get_env_or_default("HOLD_PICKUP_DAYS", "3"))),
+          hold_wait_days(std::stoi(get_env_or_default("HOLD_WAIT_DAYS", "30"))),
+          worker_count(std::max<size_t>(workers, 1)),
+          requests(std::max<size_t>(queue_size, 1)),
+          handled(0) {
+        std::chrono::seconds refresh(std::stoi(get_env_or_default("HOLD_QUEUE_REFRESH_SECONDS", "5")));
+        for (const auto& config : shard_configs) {
+            shards.push_back(Shard{config.branch, std::make_unique<ConnectionPool>(config.conn_str, worker_count),
+                                   std::make_unique<HoldQueues>(refresh)});
+        }
+    }
 
-            pqxx::work txn(*conn);
+    int run(const std::string& address) {
+        std::signal(SIGINT, stop_signal_handler);
+        std::signal(SIGTERM, stop_signal_handler);
 
-            txn.exec(R"(
-                INSERT INTO genres (genre_id, genre) VALUES
-                (1, 'Фантастика'),
-                (2, 'История'),
-                (3, 'Классика'),
-                (4, 'Научпоп')
-            )");
+        std::string unix_path;
+        int listen_fd = -1;
+        int epoll_fd = -1;
+        std::unordered_map<int, std::shared_ptr<ServiceClient>> clients;
+        std::vector<int> paused;
+        std::vector<std::thread> workers;
+        int status = 0;
 
-            txn.exec(R"(
-                INSERT INTO authors (author_id, full_name, country) VALUES
-                (1, 'Айзек Азимов', 'США'),
-                (2, 'Лев Толстой', 'Россия'),
-                (3, 'Юваль Харари', 'Израиль'),
-                (4, 'Братья Стругацкие', 'Россия')
-            )");
+        try {
+            listen_fd = openListener(address, unix_path);
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_fd < 0) {
+                throw std::runtime_error("epoll_create1: " + std::string(std::strerror(errno)));
+            }
+            epoll_event listen_event{};
+            listen_event.events = EPOLLIN;
+            listen_event.data.fd = listen_fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event);
 
-            txn.exec(R"(
-                INSERT INTO readers (reader_id, full_name, "group", email, status, registration_date) VALUES
-                (1, 'Иван Петров', 'БИБ-101', 'ivan@example.com', 'active', CURRENT_DATE - 30),
-                (2, 'Мария Соколова', 'БИБ-102', 'maria@example.com', 'active', CURRENT_DATE - 10),
-                (3, 'Алексей Ким', NULL, 'alex@example.com', 'inactive', CURRENT_DATE - 100)
-            )");
+            for (size_t i = 0; i < worker_count; ++i) {
+                workers.emplace_back(&LibraryService::workerLoop, this);
+            }
+            std::cout << "Сервис слушает " << address << ", обработчиков: " << worker_count << std::endl;
 
-            txn.exec(R"(
-                INSERT INTO books (book_id, genre_id, title, isbn, published_year, language, is_reference) VALUES
-                (1, 1, 'Основание', '978-1-234', 1951, 'ru', false),
-                (2, 3, 'Война и мир', '978-1-235', 1869, 'ru', false),
-                (3, 4, 'Sapiens', '978-1-236', 2011, 'en', false),
-                (4, 1, 'Понедельник начинается в субботу', '978-1-237', 1965, 'ru', false)
-            )");
+            timeval send_timeout{std::stoi(get_env_or_default("SERVE_SEND_TIMEOUT_SECONDS", "5")), 0};
+            auto watch = [epoll_fd](int fd) {
+                epoll_event client_event{};
+                client_event.events = EPOLLIN;
+                client_event.data.fd = fd;
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &client_event);
+            };
+            auto settle = [&](int fd, ReadState state) {
+                if (state == ReadState::Open) return;
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                if (state == ReadState::Paused) {
+                    paused.push_back(fd);
+                    return;
+                }
+                auto client = clients.find(fd);
+                client->second->stop_reading();
+                clients.erase(client);
+            };
 
-            txn.exec(R"(
-                INSERT INTO book_authors (book_id, author_id) VALUES
-                (1, 1),
-                (2, 2),
-                (3, 3),
-                (4, 4)
-            )");
-
-            txn.exec(R"(
-                INSERT INTO copies (copy_id, book_id, inventory_number, location, status) VALUES
-                (1, 1, 'INV-001', 'Абонемент', 'in_stock'),
-                (2, 1, 'INV-002', 'Зал 1', 'loaned'),
-                (3, 2, 'INV-003', 'Абонемент', 'loaned'),
-                (4, 3, 'INV-004', 'Зал 2', 'in_stock'),
-                (5, 4, 'INV-005', 'Зал 1', 'in_stock')
-            )");
-
-            txn.exec(R"(
-                INSERT INTO loans (loan_id, reader_id, copy_id, loan_date, due_date, return_date, fine_amount) VALUES
-                (1, 1, 2, CURRENT_DATE - 15, CURRENT_DATE - 5, NULL, 0),
-                (2, 2, 3, CURRENT_DATE - 7, CURRENT_DATE + 7, NULL, 0)
-            )");
+            epoll_event events[64];
+            while (!stop_requested) {
+                int ready = epoll_wait(epoll_fd, events, 64, paused.empty() ? 500 : 10);
+                if (ready < 0) {
+                    if (errno == EINTR) continue;
+                    throw std::runtime_error("epoll_wait: " + std::string(std::strerror(errno)));
+                }
 
-            txn.commit();
+                for (int i = 0; i < ready; ++i) {
+                    int fd = events[i].data.fd;
+                    if (fd == listen_fd) {
+                        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                        if (client_fd < 0) continue;
+                        setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+                        clients[client_fd] = std::make_shared<ServiceClient>(client_fd);
+                        watch(client_fd);
+                        continue;
+                    }
 
-            pqxx::work reset_seq(*conn);
-            reset_seq.exec("SELECT setval('genres_genre_id_seq', COALESCE((SELECT MAX(genre_id) FROM genres), 0) + 1, false)");
-            reset_seq.exec("SELECT setval('authors_author_id_seq', COALESCE((SELECT MAX(author_id) FROM authors), 0) + 1, false)");
-            reset_seq.exec("SELECT setval('readers_reader_id_seq', COALESCE((SELECT MAX(reader_id) FROM readers), 0) + 1, false)");
-            reset_seq.exec("SELECT setval('books_book_id_seq', COALESCE((SELECT MAX(book_id) FROM books), 0) + 1, false)");
-            reset_seq.exec("SELECT setval('copies_copy_id_seq', COALESCE((SELECT MAX(copy_id) FROM copies), 0) + 1, false)");
-            reset_seq.exec("SELECT setval('loans_loan_id_seq', COALESCE((SELECT MAX(loan_id) FROM loans), 0) + 1, false)");
-            reset_seq.commit();
+                    auto client = clients.find(fd);
+                    if (client == clients.end()) continue;
+                    settle(fd, readClient(client->second, fd));
+                }
 
-            std::cout << "Все тестовые данные успешно добавлены!" << std::endl;
+                std::vector<int> waiting;
+                waiting.swap(paused);
+                for (size_t i = 0; i < waiting.size(); ++i) {
+                    if (!requests.has_room()) {
+                        paused.insert(paused.end(), waiting.begin() + static_cast<long>(i), waiting.end());
+                        break;
+                    }
+                    int fd = waiting[i];
+                    ReadState state = queueLines(clients[fd]);
+                    if (state == ReadState::Open) {
+                        watch(fd);
+                    } else if (state == ReadState::Paused) {
+                        paused.push_back(fd);
+                    } else {
+                        clients[fd]->stop_reading();
+                        clients.erase(fd);
+                    }
+                }
+            }
         } catch (const std::exception &e) {
             std::cerr << "Ошибка: " << e.what() << std::endl;
+            stop_requested = 1;
+            status = 1;
+        }
+
+        requests.close();
+        for (auto& worker : workers) {
+            worker.join();
         }
+        clients.clear();
+        if (epoll_fd >= 0) ::close(epoll_fd);
+        if (listen_fd >= 0) ::close(listen_fd);
+        if (!unix_path.empty()) unlink(unix_path.c_str());
+
+        std::cout << "Сервис остановлен, обработано запросов: " << handled.load() << std::endl;
+        return status;
     }
 };
 
-static std::string get_env_or_default(const char* key, const std::string& def) {
-    const char* val = std::getenv(key);
-    return val ? std::string(val) : def;
+static int run_service(const std::vector<ShardConfig>& shard_configs) {
+    std::string address = get_env_or_default("SERVE_ADDR", "127.0.0.1:7070");
+    size_t workers = static_cast<size_t>(std::stoi(get_env_or_default("SERVE_WORKERS", "4")));
+    size_t queue_size = static_cast<size_t>(std::stoi(get_env_or_default("SERVE_QUEUE", "256")));
+
+    LibraryService service(shard_configs, workers, queue_size);
+    return service.run(address);
 }
 
-static std::string build_conn_string() {
+static int run_plan_regression(const std::string& conn_str, bool record) {
     std::string host = get_env_or_default("DB_HOST", "localhost");
-    std::string port = get_env_or_default("DB_PORT", "5432");
-    std::string name = get_env_or_default("DB_NAME", "library");
-    std::string user = get_env_or_default("DB_USER", "postgres");
-    std::string pass = get_env_or_default("DB_PASSWORD", "postgres");
+    if (!is_local_host(host)) {
+        std::cerr << "Проверка планов запускается только на локальном PostgreSQL (DB_HOST = "
+                  << host << ")" << std::endl;
+        return 2;
+    }
 
-    return "host=" + host + " port=" + port + " dbname=" + name + " user=" + user + " password=" + pass;
+    std::vector<int> scales;
+    std::stringstream list(get_env_or_default("PLAN_SCALES", "1,10"));
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (!item.empty()) scales.push_back(std::stoi(item));
+    }
+
+    try {
+        PlanRegression regression(
+            conn_str,
+            scales,
+            std::stod(get_env_or_default("PLAN_TOLERANCE", "0.5")),
+            get_env_or_default("PLAN_BASELINE", "plans/baseline.tsv")
+        );
+        return record ? regression.record() : regression.check();
+    } catch (const std::exception &e) {
+        std::cerr << "Ошибка: " << e.what() << std::endl;
+        return 2;
+    }
 }
 
 void execute_10_queries(LibraryDB& db) {
@@ -661,7 +4842,7 @@ void execute_10_queries(LibraryDB& db) {
     int query_choice;
     do {
         std::cout << "\n═══════════════════════════════════════════" << std::endl;
-        std::cout << "Выберите запрос (1-10) или 0 для выхода:" << std::endl;
+        std::cout << "Выберите запрос (1-13) или 0 для выхода:" << std::endl;
         std::cout << "1. Книги по жанру" << std::endl;
         std::cout << "2. Книги с несколькими авторами" << std::endl;
         std::cout << "3. Авторы и количество книг" << std::endl;
@@ -672,10 +4853,14 @@ void execute_10_queries(LibraryDB& db) {
         std::cout << "8. Возврат книги" << std::endl;
         std::cout << "9. Добавление читателя" << std::endl;
         std::cout << "10. Выдача книги" << std::endl;
+        std::cout << "11. Забронировать книгу" << std::endl;
+        std::cout << "12. Позиция в очереди на книгу" << std::endl;
+        std::cout << "13. Обработать просроченные брони" << std::endl;
         std::cout << "0. Выход в главное меню" << std::endl;
         std::cout << "═══════════════════════════════════════════" << std::endl;
         std::cout << "Выбор: ";
         std::cin >> query_choice;
+        db.restore_connections();
 
         switch (query_choice) {
             case 1: {
@@ -733,6 +4918,30 @@ void execute_10_queries(LibraryDB& db) {
                 db.query10_issue_loan(reader_id, copy_id, due_date);
                 break;
             }
+            case 11:
+            case 12: {
+                int reader_id;
+                int book_id;
+                std::cout << "\nВведите reader_id: ";
+                std::cin >> reader_id;
+                std::cout << "Введите book_id: ";
+                std::cin >> book_id;
+                std::string branch;
+                if (db.shard_count() > 1) {
+                    std::cout << "Введите филиал: ";
+                    std::cin.ignore();
+                    std::getline(std::cin, branch);
+                }
+                if (query_choice == 11) {
+                    db.query11_place_hold(reader_id, book_id, branch);
+                } else {
+                    db.query12_hold_position(reader_id, book_id, branch);
+                }
+                break;
+            }
+            case 13:
+                db.query13_expire_holds();
+                break;
             case 0:
                 std::cout << "Возврат в главное меню..." << std::endl;
                 break;
@@ -786,9 +4995,24 @@ void execute_sql_injections(LibraryDB& db) {
     } while (injection_choice != 0);
 }
 
-int main() {
-    std::string conn_str = build_conn_string();
-    LibraryDB db(conn_str);
+int main(int argc, char* argv[]) {
+    std::vector<ShardConfig> shard_configs = build_shard_configs();
+    std::string conn_str = shard_configs.front().conn_str;
+    if (argc > 1 && std::string(argv[1]) == "--reminders") {
+        return run_reminders(shard_configs);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--serve") {
+        return run_service(shard_configs);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--plan-baseline") {
+        return run_plan_regression(conn_str, true);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--plan-check") {
+        return run_plan_regression(conn_str, false);
+    }
+
+    LibraryDB db(shard_configs);
+    std::signal(SIGINT, interrupt_handler);
 
     int choice;
     do {
@@ -801,10 +5025,14 @@ int main() {
         std::cout << "4. Демонстрация SQL-инъекций" << std::endl;
         std::cout << "5. Безопасный поиск книги" << std::endl;
         std::cout << "6. Безопасное добавление книги" << std::endl;
+        std::cout << "7. Сводка по выдачам (параллельно)" << std::endl;
+        std::cout << "8. Карточка читателя" << std::endl;
+        std::cout << "9. Проверка сводок читателей" << std::endl;
         std::cout << "0. Выход" << std::endl;
         std::cout << "═══════════════════════════════════════════" << std::endl;
         std::cout << "Выбор: ";
         std::cin >> choice;
+        db.restore_connections();
 
         switch (choice) {
             case 1:
@@ -830,6 +5058,19 @@ int main() {
             case 6:
                 db.safe_insert_book();
                 break;
+            case 7:
+                db.loans_dashboard();
+                break;
+            case 8: {
+                int reader_id;
+                std::cout << "Введите reader_id: ";
+                std::cin >> reader_id;
+                db.reader_card(reader_id);
+                break;
+            }
+            case 9:
+                db.reader_summaries_check();
+                break;
             case 0:
                 std::cout << "Выход из программы..." << std::endl;
                 break;